@@ -4,7 +4,7 @@ include $(CLEAR_VARS)
 LOCAL_MODULE    := onehook
 LOCAL_ARM_MODE	:= thumb
 LOCAL_LDLIBS	:= -llog -landroid_runtime -lutils -lcutils -lart -ldvm
-LOCAL_CFLAGS	:= -std=gnu++11 -fpermissive -DDEBUG -O0
+LOCAL_CFLAGS	:= -std=gnu++11 -fpermissive -DLOG_MIN_LEVEL=LOG_LEVEL_WARN
 LOCAL_SRC_FILES := \
 	JavaHook/JavaMethodHook.cpp \
 	JavaHook/ArtMethodHook.cpp \
@@ -13,6 +13,24 @@ LOCAL_SRC_FILES := \
 	ElfHook/elfhook.cpp \
 	ElfHook/elfio.cpp \
 	ElfHook/elfutils.cpp \
+	ElfHook/elfmodule.cpp \
+	ElfHook/elfpatch.cpp \
+	ElfHook/elfscan.cpp \
+	ElfHook/elfobserver.cpp \
+	ElfHook/elfplan.cpp \
+	ElfHook/elfchain.cpp \
+	ElfHook/elfthunk.cpp \
+	ElfHook/elfguard.cpp \
+	ElfHook/elftable.cpp \
+	ElfHook/elfsymbolize.cpp \
+	ElfHook/elfstats.cpp \
+	ElfHook/elfstats_entry.S \
+	ElfHook/elftrace.cpp \
+	InlineHook/inlinehook.cpp \
+	InlineHook/x64insn.cpp \
+	InlineHook/arm64insn.cpp \
+	InlineHook/thumbinsn.cpp \
+	asynclog.cpp \
 	main.cpp
 include $(BUILD_SHARED_LIBRARY)
 
@@ -0,0 +1,19 @@
+/*
+ * benchcaller.c
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+int bench_target(int x);
+
+/**
+ * 通过PLT调用n次bench_target, GOT hook改的就是这个模块的槽
+ */
+int bench_loop(int n){
+	int sum = 0;
+	for(int i = 0; i < n; i++){
+		sum += bench_target(i);
+	}
+	return sum;
+}
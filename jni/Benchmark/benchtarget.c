@@ -0,0 +1,16 @@
+/*
+ * benchtarget.c
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+static volatile int sink;
+
+/**
+ * 被hook的函数, 开头的指令足够放下inline hook的5字节跳转
+ */
+__attribute__((noinline)) int bench_target(int x){
+	sink += x;
+	return x + 1;
+}
@@ -0,0 +1,266 @@
+/*
+ * hookbench.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#include "common.h"
+#include "ElfHook/elfhook.h"
+#include "InlineHook/inlinehook.h"
+
+#define CALLER_SONAME "libbenchcaller.so"
+#define TARGET_SYMBOL "bench_target"
+
+extern "C" int bench_loop(int n);
+
+typedef int (*target_fun)(int);
+
+static target_fun old_target = NULL;
+static volatile int sink;
+
+/**
+ * 和bench_target做同样的事, 衡量只替换不转发时的开销
+ */
+static int fast_target(int x){
+	sink += x;
+	return x + 1;
+}
+
+/**
+ * 转发到原函数, 衡量替换函数再调用old_func的开销
+ */
+static int pass_target(int x){
+	return old_target(x);
+}
+
+static int target_guard = elfGuardAlloc();
+
+/**
+ * 自己持有HookGuard再转发, 和got_guarded对比
+ */
+static int scoped_target(int x){
+	HookGuard guard(target_guard);
+	return old_target(x);
+}
+
+enum {
+	HOOK_NONE,
+	HOOK_GOT,
+	HOOK_GOT_GUARDED,
+	HOOK_INLINE,
+	HOOK_STATS
+};
+
+struct BenchCase {
+	const char *name;
+	int kind;
+	void *replace_func;
+};
+
+static const BenchCase cases[] = {
+	{"direct", HOOK_NONE, NULL},
+	{"got", HOOK_GOT, (void *)fast_target},
+	{"got_passthrough", HOOK_GOT, (void *)pass_target},
+	{"got_guarded", HOOK_GOT_GUARDED, (void *)pass_target},
+	{"got_scoped_guard", HOOK_GOT, (void *)scoped_target},
+	{"inline", HOOK_INLINE, (void *)fast_target},
+	{"inline_passthrough", HOOK_INLINE, (void *)pass_target},
+	{"got_instrumented", HOOK_STATS, NULL}
+};
+
+/**
+ * 每次调用的耗时分布, 单位ns
+ */
+struct BenchResult {
+	const char *name;
+	bool ok;
+	double min;
+	double mean;
+	double p50;
+	double p90;
+	double p99;
+	double p999;
+	double max;
+};
+
+static inline uint64_t nowNs(){
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compareDouble(const void *a, const void *b){
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+static inline double percentile(const double *sorted, int n, double q){
+	int i = (int)(q * n);
+	return sorted[i < n ? i : n - 1];
+}
+
+/**
+ * samples次采样, 每次调用batch次bench_target, 采样值为平均每次调用的耗时
+ */
+static void runSamples(int samples, int batch, BenchResult *result){
+	double *ns = (double *) malloc(sizeof(double) * samples);
+	double total = 0;
+
+	// warm up the caches, the branch predictor and lazy binding
+	bench_loop(batch * 16);
+
+	for(int i = 0; i < samples; i++){
+		uint64_t start = nowNs();
+		bench_loop(batch);
+		ns[i] = (double)(nowNs() - start) / batch;
+		total += ns[i];
+	}
+
+	qsort(ns, samples, sizeof(double), compareDouble);
+
+	result->min = ns[0];
+	result->mean = total / samples;
+	result->p50 = percentile(ns, samples, 0.5);
+	result->p90 = percentile(ns, samples, 0.9);
+	result->p99 = percentile(ns, samples, 0.99);
+	result->p999 = percentile(ns, samples, 0.999);
+	result->max = ns[samples - 1];
+
+	free(ns);
+}
+
+static void runCase(const BenchCase *bench, void *target, int samples, int batch, BenchResult *result){
+	memset(result, 0, sizeof(BenchResult));
+	result->name = bench->name;
+
+	int res = 0;
+	switch(bench->kind){
+	case HOOK_GOT:
+		res = elfHook(CALLER_SONAME, TARGET_SYMBOL, bench->replace_func, (void **)&old_target);
+		break;
+
+	case HOOK_GOT_GUARDED:
+		res = elfHookGuarded(CALLER_SONAME, TARGET_SYMBOL, bench->replace_func, (void **)&old_target);
+		break;
+
+	case HOOK_INLINE:
+		res = inlineHook(target, bench->replace_func, (void **)&old_target);
+		break;
+
+	case HOOK_STATS:
+		res = elfHookInstrument(CALLER_SONAME, TARGET_SYMBOL) < 0;
+		break;
+	}
+
+	if(res){
+		fprintf(stderr, "%s: could not install the hook.\n", bench->name);
+		return;
+	}
+
+	runSamples(samples, batch, result);
+	result->ok = true;
+
+	switch(bench->kind){
+	case HOOK_GOT:
+	case HOOK_GOT_GUARDED:
+	case HOOK_STATS:
+		elfUnhook(CALLER_SONAME, TARGET_SYMBOL);
+		break;
+
+	case HOOK_INLINE:
+		inlineUnhook(target);
+		break;
+	}
+}
+
+static void printTable(const BenchResult *results, int n){
+	printf("%-20s %9s %9s %9s %9s %9s %9s %9s\n", "ns/call", "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+	for(int i = 0; i < n; i++){
+		const BenchResult &r = results[i];
+		if(!r.ok){
+			printf("%-20s %9s\n", r.name, "failed");
+			continue;
+		}
+		printf("%-20s %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n", r.name, r.min, r.mean, r.p50, r.p90, r.p99,
+				r.p999, r.max);
+	}
+}
+
+static void printJson(const BenchResult *results, int n, int samples, int batch){
+	printf("{\"unit\": \"ns/call\", \"samples\": %d, \"batch\": %d, \"results\": [", samples, batch);
+	for(int i = 0; i < n; i++){
+		const BenchResult &r = results[i];
+		printf("%s\n  {\"name\": \"%s\", \"ok\": %s", i ? "," : "", r.name, r.ok ? "true" : "false");
+		if(r.ok){
+			printf(", \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p99.9\": %.3f, \"max\": %.3f",
+					r.min, r.mean, r.p50, r.p90, r.p99, r.p999, r.max);
+		}
+		printf("}");
+	}
+	printf("\n]}\n");
+}
+
+static void usage(const char *prog){
+	fprintf(stderr, "usage: %s [--json] [--samples N] [--batch N] [--filter NAME]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv){
+	bool json = false;
+	int samples = 2000;
+	int batch = 1000;
+	const char *filter = NULL;
+
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "--json")){
+			json = true;
+		}else if(!strcmp(argv[i], "--samples") && i + 1 < argc){
+			samples = atoi(argv[++i]);
+		}else if(!strcmp(argv[i], "--batch") && i + 1 < argc){
+			batch = atoi(argv[++i]);
+		}else if(!strcmp(argv[i], "--filter") && i + 1 < argc){
+			filter = argv[++i];
+		}else{
+			usage(argv[0]);
+		}
+	}
+
+	if(samples <= 0 || batch <= 0){
+		usage(argv[0]);
+	}
+
+	// the real entry in libbenchtarget.so, not a plt stub of the executable
+	void *target = dlsym(RTLD_DEFAULT, TARGET_SYMBOL);
+	if(!target){
+		fprintf(stderr, "%s not found: %s\n", TARGET_SYMBOL, dlerror());
+		return 1;
+	}
+
+	const int ncases = sizeof(cases) / sizeof(cases[0]);
+	BenchResult results[ncases];
+	int n = 0;
+
+	for(int i = 0; i < ncases; i++){
+		if(filter && !strstr(cases[i].name, filter)){
+			continue;
+		}
+		runCase(cases + i, target, samples, batch, results + n++);
+	}
+
+	if(json){
+		printJson(results, n, samples, batch);
+	}else{
+		printTable(results, n);
+	}
+
+	return 0;
+}
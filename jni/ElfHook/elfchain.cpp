@@ -0,0 +1,231 @@
+/*
+ * elfchain.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "elfhook.h"
+#include "elfmodule.h"
+#include "elfpatch.h"
+
+struct HookChain;
+
+/**
+ * 链中的一层, next是调用者提供的变量, 保存下一层的入口
+ */
+struct HookLink {
+	HookLink *next_link;
+	HookChain *chain;
+	void *replace_func;
+	void **next;
+	int priority;
+};
+
+/**
+ * 一个模块中一个符号的hook链, 槽指向第一层, 最后一层的next是原函数
+ */
+struct HookChain {
+	HookChain *next;
+
+	ElfModule *module;
+	char *symbol;
+	char *version;
+
+	void ***addrs;
+	size_t naddrs;
+	void *original;
+
+	HookLink *links;
+};
+
+static HookChain *chains = NULL;
+
+// only taken while the chains change, hooked calls never see it
+static pthread_mutex_t chain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool sameVersion(const char *a, const char *b){
+	if(!a || !b){
+		return a == b;
+	}
+	return strcmp(a, b) == 0;
+}
+
+static HookChain *findChain(ElfModule *module, const char *symbol, const char *version){
+	for(HookChain *chain = chains; chain; chain = chain->next){
+		if(chain->module == module && !strcmp(chain->symbol, symbol) && sameVersion(chain->version, version)){
+			return chain;
+		}
+	}
+	return NULL;
+}
+
+static HookChain *createChain(ElfModule *module, const char *symbol, const char *version){
+	ElfSymSlots slots;
+	if(!findSymSlots(module, symbol, version, &slots) || !slots.count){
+		LOGE("[-] Could not find symbol %s@%s", symbol, version ? version : "");
+		return NULL;
+	}
+
+	HookChain *chain = (HookChain *) calloc(1, sizeof(HookChain));
+	chain->module = module;
+	chain->symbol = strdup(symbol);
+	chain->version = version ? strdup(version) : NULL;
+
+	chain->addrs = (void ***) malloc(sizeof(void **) * slots.count);
+	chain->naddrs = slots.count;
+	for(size_t i = 0; i < slots.count; i++){
+		chain->addrs[i] = getSymSlotAddr(module, &slots, i);
+	}
+
+	// the value the last layer calls, an earlier elfHook stays below the chain
+	chain->original = __atomic_load_n(chain->addrs[0], __ATOMIC_ACQUIRE);
+
+	chain->next = chains;
+	chains = chain;
+	return chain;
+}
+
+static void freeChain(HookChain *chain){
+	for(HookChain **it = &chains; *it; it = &(*it)->next){
+		if(*it == chain){
+			*it = chain->next;
+			break;
+		}
+	}
+
+	free(chain->symbol);
+	free(chain->version);
+	free(chain->addrs);
+	free(chain);
+}
+
+static inline void *getLinkEntry(const HookChain *chain, const HookLink *link){
+	return link ? link->replace_func : chain->original;
+}
+
+/**
+ * 把链的所有槽指向func
+ */
+static int writeChainSlots(HookChain *chain, void *func){
+	ElfPatchBuffer buffer = {NULL, 0, 0};
+	for(size_t i = 0; i < chain->naddrs; i++){
+		addPatch(&buffer, chain->addrs[i], func, NULL);
+	}
+
+	int res = applyPatches(&buffer);
+	freePatchBuffer(&buffer);
+	return res;
+}
+
+HookLink *elfHookChain(const char *soname, const char *symbol, void *replace_func, void **next, int priority, const char *version){
+	assert(symbol);
+	assert(replace_func);
+	assert(next);
+
+	ElfModule *module = getElfModule(soname);
+	if(!module){
+		return NULL;
+	}
+
+	pthread_mutex_lock(&chain_lock);
+
+	HookChain *chain = findChain(module, symbol, version);
+	if(!chain){
+		chain = createChain(module, symbol, version);
+		if(!chain){
+			pthread_mutex_unlock(&chain_lock);
+			return NULL;
+		}
+	}
+
+	for(HookLink *it = chain->links; it; it = it->next_link){
+		if(it->replace_func == replace_func){
+			pthread_mutex_unlock(&chain_lock);
+			LOGW("[*] %p is in the chain of %s already.", replace_func, symbol);
+			return NULL;
+		}
+	}
+
+	// layers with the same priority keep the order they were added in
+	HookLink *prev = NULL;
+	HookLink *succ = chain->links;
+	while(succ && succ->priority <= priority){
+		prev = succ;
+		succ = succ->next_link;
+	}
+
+	HookLink *link = (HookLink *) calloc(1, sizeof(HookLink));
+	link->chain = chain;
+	link->replace_func = replace_func;
+	link->next = next;
+	link->priority = priority;
+	link->next_link = succ;
+
+	// the new layer can reach the next one before any caller can reach it
+	__atomic_store_n(next, getLinkEntry(chain, succ), __ATOMIC_RELEASE);
+
+	if(prev){
+		__atomic_store_n(prev->next, replace_func, __ATOMIC_RELEASE);
+	}else if(writeChainSlots(chain, replace_func)){
+		if(!chain->links){
+			freeChain(chain);
+		}
+		pthread_mutex_unlock(&chain_lock);
+		free(link);
+		return NULL;
+	}
+
+	if(prev){
+		prev->next_link = link;
+	}else{
+		chain->links = link;
+	}
+
+	pthread_mutex_unlock(&chain_lock);
+
+	LOGI("[+] %p was added to the chain of %s in %s, priority %d.", replace_func, symbol, module->soname, priority);
+	return link;
+}
+
+int elfUnhookChain(HookLink *link){
+	assert(link);
+
+	pthread_mutex_lock(&chain_lock);
+
+	HookChain *chain = link->chain;
+	HookLink *prev = NULL;
+	for(HookLink *it = chain->links; it != link; it = it->next_link){
+		assert(it);
+		prev = it;
+	}
+
+	// callers inside link keep going through its next, which stays valid
+	void *entry = getLinkEntry(chain, link->next_link);
+	if(prev){
+		__atomic_store_n(prev->next, entry, __ATOMIC_RELEASE);
+		prev->next_link = link->next_link;
+	}else{
+		if(writeChainSlots(chain, entry)){
+			pthread_mutex_unlock(&chain_lock);
+			return -1;
+		}
+		chain->links = link->next_link;
+	}
+
+	LOGI("[+] %p was removed from the chain of %s.", link->replace_func, chain->symbol);
+
+	if(!chain->links){
+		freeChain(chain);
+	}
+	free(link);
+
+	pthread_mutex_unlock(&chain_lock);
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * elfguard.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "elfhook.h"
+#include "elfguard.h"
+#include "elfthunk.h"
+
+/**
+ * 一个带重入保护的hook, 同一对(replace_func, old_func)在所有模块中共用
+ * 前四项由elf_guard_call读取, 顺序不能改变
+ */
+struct GuardEntry {
+	void *replace_func;
+	void **old_func;
+
+	// ELF_GUARD_TLS时是标记字节与线程指针的距离, 否则是它在elf_guard_bits中的下标
+	intptr_t byte;
+	uintptr_t mask;
+
+	void *thunk;
+};
+
+#if defined(__ANDROID__)
+__thread uint8_t elf_guard_bits[HOOK_GUARD_MAX / 8];
+#else
+__thread uint8_t elf_guard_bits[HOOK_GUARD_MAX / 8] __attribute__((tls_model("initial-exec")));
+#endif
+
+static GuardEntry *entries[HOOK_GUARD_MAX];
+static int nentries = 0;
+static int nids = 0;
+static pthread_mutex_t guard_lock = PTHREAD_MUTEX_INITIALIZER;
+
+extern "C" {
+
+// elfstats_entry.S
+void elf_guard_call();
+
+}
+
+uint8_t *elfGuardThreadBits(){
+	return elf_guard_bits;
+}
+
+#if ELF_GUARD_TLS
+static inline uintptr_t getThreadPointer(){
+	uintptr_t tp = 0;
+#if defined(__x86_64__)
+	__asm__("mov %%fs:0, %0" : "=r"(tp));
+#elif defined(__aarch64__)
+	__asm__("mrs %0, tpidr_el0" : "=r"(tp));
+#elif defined(__arm__)
+	__asm__("mrc p15, 0, %0, c13, c0, 3" : "=r"(tp));
+#endif
+	return tp;
+}
+#endif
+
+void *getGuardThunk(void *replace_func, void **old_func){
+	pthread_mutex_lock(&guard_lock);
+
+	for(int i = 0; i < nentries; i++){
+		if(entries[i]->replace_func == replace_func && entries[i]->old_func == old_func){
+			pthread_mutex_unlock(&guard_lock);
+			return entries[i]->thunk;
+		}
+	}
+
+	int id = elfGuardAlloc();
+	if(id < 0){
+		pthread_mutex_unlock(&guard_lock);
+		return NULL;
+	}
+
+	GuardEntry *entry = (GuardEntry *) calloc(1, sizeof(GuardEntry));
+	entry->replace_func = replace_func;
+	entry->old_func = old_func;
+	entry->mask = 1 << (id & 7);
+
+#if ELF_GUARD_TLS
+	entry->byte = (intptr_t)(&elf_guard_bits[id >> 3]) - (intptr_t)getThreadPointer();
+	entry->thunk = createGuardThunk(entry, elf_guard_call, old_func, entry->byte, entry->mask);
+#else
+	entry->byte = id >> 3;
+#endif
+
+	// the offset does not fit in the inline check
+	if(!entry->thunk){
+		entry->thunk = createWrapperThunk(entry, elf_guard_call);
+	}
+
+	if(!entry->thunk){
+		pthread_mutex_unlock(&guard_lock);
+		free(entry);
+		LOGE("[-] could not create the guard of %p.", replace_func);
+		return NULL;
+	}
+
+	entries[nentries++] = entry;
+	pthread_mutex_unlock(&guard_lock);
+
+	return entry->thunk;
+}
+
+int elfGuardAlloc(){
+	int id = __atomic_fetch_add(&nids, 1, __ATOMIC_RELAXED);
+	if(id >= HOOK_GUARD_MAX){
+		LOGE("[-] too many hook guards.");
+		return -1;
+	}
+
+	return id;
+}
@@ -0,0 +1,44 @@
+/*
+ * elfguard.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFGUARD_H_
+#define ELFGUARD_H_
+
+/**
+ * 为1时elf_guard_bits是initial-exec模型, 与线程指针的距离固定, 入口直接读取标记
+ * bionic的dlopen不接受initial-exec的TLS, Android 10以前还只有模拟TLS, 所以在Android上
+ * 入口通过elfGuardThreadBits取得本线程的标记
+ */
+#if defined(__ANDROID__)
+#define ELF_GUARD_TLS 0
+#else
+#define ELF_GUARD_TLS 1
+#endif
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+/**
+ * 获取replace_func的重入保护入口, 写入槽的是它而不是replace_func
+ * 同一线程在replace_func返回前再次经过这个入口时, 直接跳到*old_func
+ * 同一对(replace_func, old_func)总是返回同一个入口, 失败返回NULL
+ */
+void *getGuardThunk(void *replace_func, void **old_func);
+
+extern "C" {
+
+/**
+ * 本线程的标记, 即elf_guard_bits, 供elf_guard_call在ELF_GUARD_TLS为0时使用
+ */
+uint8_t *elfGuardThreadBits() __attribute__((visibility("hidden")));
+
+}
+
+#endif
+
+#endif /* ELFGUARD_H_ */
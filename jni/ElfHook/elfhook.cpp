@@ -11,105 +11,239 @@
 #include <assert.h>
 #include <errno.h>
 #include <string.h>
-#include <sys/syscall.h>
+#include <stdlib.h>
 
 #include "common.h"
+#include "elfhook.h"
 #include "elfutils.h"
 #include "elfio.h"
+#include "elfmodule.h"
+#include "elfpatch.h"
+#include "elfscan.h"
 
+int elfHookMany(const char *soname, const HookSpec *specs, size_t n){
+	assert(specs);
 
-#define PAGE_START(addr) (~(getpagesize() - 1) & (addr))
+	ElfModule *module = getElfModule(soname);
+	if(!module){
+		return -1;
+	}
+
+	return hookElfModule(module, specs, n, NULL, true);
+}
+
+int elfHook(const char *soname, const char *symbol, void *replace_func, void **old_func, const char *version){
+	assert(old_func);
+	assert(replace_func);
+	assert(symbol);
+
+	HookSpec spec = {symbol, replace_func, old_func, version, 0};
+	return elfHookMany(soname, &spec, 1);
+}
+
+int elfHookGuarded(const char *soname, const char *symbol, void *replace_func, void **old_func, const char *version){
+	assert(old_func);
+	assert(replace_func);
+	assert(symbol);
 
-static int modifyMemAccess(void *addr, int prots){
-	void *page_start_addr = (void *)PAGE_START((uint32_t)addr);
-	return mprotect(page_start_addr, getpagesize(), prots);
+	HookSpec spec = {symbol, replace_func, old_func, version, HOOK_GUARDED};
+	return elfHookMany(soname, &spec, 1);
 }
 
-static int clearCache(void *addr, size_t len){
-	void *end = (uint8_t *)addr + len;
-	syscall(0xf0002, addr, end);
+int elfHookAll(const char *symbol, void *replace_func, void **old_func, HookResult *results, size_t nresults, const char *version){
+	assert(old_func);
+	assert(replace_func);
+	assert(symbol);
+
+	HookSpec spec = {symbol, replace_func, old_func, version, 0};
+
+	const ElfLibTable *table = acquireLibTable();
+	const ElfLibInfo *libs = NULL;
+	size_t nlibs = getLibInfos(table, &libs);
+	size_t nmodules = 0;
+
+	for(size_t i = 0; i < nlibs; i++){
+		ElfModule *module = getElfModuleByLib(libs + i);
+
+		// the hook plan or the hash table tells whether the module imports the symbol at all
+		ElfSymSlots slots;
+		if(!findSymSlots(module, symbol, version, &slots) || !slots.count){
+			continue;
+		}
+
+		// the slots are already resolved, patch them directly
+		ElfPatchBuffer buffer = {NULL, 0, 0};
+		collectSymSlotPatches(module, &spec, &slots, &buffer);
+
+		int status = applyPatches(&buffer);
+		size_t npatched = status ? 0 : buffer.npatches;
+		freePatchBuffer(&buffer);
+
+		if(nmodules < nresults){
+			HookResult &result = results[nmodules];
+			result.soname = module->soname;
+			result.base = module->handle->base;
+			result.nslots = npatched;
+			result.status = status;
+		}
+		nmodules++;
+	}
+
+	releaseLibTable(table);
+
+	LOGI("[+] %s was hooked in %d modules.", symbol, (int)nmodules);
+	return (int)nmodules;
 }
 
-static int replaceFunc(void *addr, void *replace_func, void **old_func){
-	int res = 0;
+int elfUnhook(const char *soname, const char *symbol, const char *version){
+	assert(symbol);
 
-	if(*(void **)addr == replace_func){
-		LOGW("addr %p had been replace.", addr);
-		goto fails;
+	ElfModule *module = getElfModule(soname);
+	if(!module){
+		return -1;
 	}
 
-	if(!*old_func){
-		*old_func = *(void **)addr;
+	ElfSymSlots slots;
+	if(!findSymSlots(module, symbol, version, &slots)){
+		LOGE("[-] Could not find symbol %s", symbol);
+		return -1;
 	}
 
-	if(modifyMemAccess((void *)addr, PROT_EXEC|PROT_READ|PROT_WRITE)){
-		LOGE("[-] modifymemAccess fails, error %s.", strerror(errno));
-		res = 1;
-		goto fails;
+	void ***addrs = (void ***) malloc(sizeof(void **) * (slots.count + 1));
+	for(size_t i = 0; i < slots.count; i++){
+		addrs[i] = getSymSlotAddr(module, &slots, i);
 	}
 
-	*(void **)addr = replace_func;
-	clearCache(addr, getpagesize());
-	LOGI("[+] old_func is %p, replace_func is %p, new_func %p.", *old_func, replace_func, *(uint32_t *)addr);
+	size_t nrestored = restorePatches(addrs, slots.count);
+	free(addrs);
 
-	fails:
-	return res;
+	LOGI("[+] %s was unhooked, %d slots restored.", symbol, (int)nrestored);
+	return nrestored;
 }
 
-#define R_ARM_ABS32 0x02
-#define R_ARM_GLOB_DAT 0x15
-#define R_ARM_JUMP_SLOT 0x16
-
-int elfHook(const char *soname, const char *symbol, void *replace_func, void **old_func){
-	assert(old_func);
+int elfHookAddress(const char *soname, void *target, void *replace_func, void **old_func){
+	assert(target);
 	assert(replace_func);
-	assert(symbol);
 
-	ElfHandle* handle = openElfBySoname(soname);
-	ElfInfo info;
+	ElfModule *module = getElfModule(soname);
+	if(!module){
+		return -1;
+	}
 
-	getElfInfoBySegmentView(info, handle);
+	ElfPatchBuffer buffer = {NULL, 0, 0};
+	collectElfModuleWords(module, target, replace_func, old_func, old_func, &buffer);
 
-	Elf32_Sym *sym = NULL;
-	int symidx = 0;
+	int res = applyPatches(&buffer);
+	size_t npatched = buffer.npatches;
+	freePatchBuffer(&buffer);
 
-	findSymByName(info, symbol, &sym, &symidx);
+	if(res){
+		return -1;
+	}
 
-	if(!sym){
-		LOGE("[-] Could not find symbol %s", symbol);
-		goto fails;
-	}else{
-		LOGI("[+] sym %p, symidx %d.", sym, symidx);
+	LOGI("[+] %p was retargeted to %p, %d pointers.", target, replace_func, (int)npatched);
+	return npatched;
+}
+
+int elfUnhookAddress(const char *soname, void *replace_func){
+	assert(replace_func);
+
+	ElfModule *module = getElfModule(soname);
+	if(!module){
+		return -1;
 	}
 
-	for (int i = 0; i < info.relpltsz; i++) {
-		Elf32_Rel& rel = info.relplt[i];
-		if (ELF32_R_SYM(rel.r_info) == symidx && ELF32_R_TYPE(rel.r_info) == R_ARM_JUMP_SLOT) {
+	ElfPatchBuffer buffer = {NULL, 0, 0};
+	collectElfModuleWords(module, replace_func, NULL, NULL, NULL, &buffer);
 
-			void *addr = (void *) (info.elf_base + rel.r_offset);
-			if (replaceFunc(addr, replace_func, old_func))
-				goto fails;
+	// only the words found in the undo log are restored
+	size_t n = buffer.npatches;
+	void ***addrs = (void ***) malloc(sizeof(void **) * (n + 1));
+	for(size_t i = 0; i < n; i++){
+		addrs[i] = buffer.patches[i].addr;
+	}
 
-			//only once
-			break;
-		}
+	size_t nrestored = restorePatches(addrs, n);
+	free(addrs);
+	freePatchBuffer(&buffer);
+
+	LOGI("[+] %p was unhooked, %d pointers restored.", replace_func, (int)nrestored);
+	return nrestored;
+}
+
+/**
+ * 事务中的所有槽, commit时一次写入
+ */
+struct HookTransaction {
+	ElfPatchBuffer buffer;
+	bool committed;
+	bool failed;
+};
+
+HookTransaction *elfHookBegin(){
+	return (HookTransaction *) calloc(1, sizeof(HookTransaction));
+}
+
+int elfHookTxnAdd(HookTransaction *txn, const char *soname, const HookSpec *specs, size_t n){
+	assert(txn);
+	assert(specs);
+	assert(!txn->committed);
+
+	ElfModule *module = getElfModule(soname);
+	if(!module){
+		txn->failed = true;
+		return -1;
 	}
 
-	for (int i = 0; i < info.reldynsz; i++) {
-		Elf32_Rel& rel = info.reldyn[i];
-		if (ELF32_R_SYM(rel.r_info) == symidx &&
-				(ELF32_R_TYPE(rel.r_info) == R_ARM_ABS32
-						|| ELF32_R_TYPE(rel.r_info) == R_ARM_GLOB_DAT)) {
+	// a spec that would write nothing fails the whole transaction
+	size_t nmissing = 0;
+	collectElfModulePatches(module, specs, n, &txn->buffer, true, &nmissing);
+	if(nmissing){
+		txn->failed = true;
+		return -1;
+	}
 
-			void *addr = (void *) (info.elf_base + rel.r_offset);
-			if (replaceFunc(addr, replace_func, old_func))
-				goto fails;
-		}
+	return 0;
+}
+
+int elfHookCommit(HookTransaction *txn){
+	assert(txn);
+	assert(!txn->committed);
+
+	if(txn->failed){
+		LOGE("[-] transaction has failed, nothing was written.");
+		return -1;
+	}
+
+	if(applyPatches(&txn->buffer)){
+		return -1;
 	}
 
-	fails:
-	closeElfBySoname(handle);
+	txn->committed = true;
+	LOGI("[+] transaction committed, %d slots.", (int)txn->buffer.npatches);
 	return 0;
 }
 
+int elfHookRollback(HookTransaction *txn){
+	assert(txn);
+
+	size_t nrestored = 0;
+	if(txn->committed){
+		// back to the values before the commit, not before the first hook
+		nrestored = revertPatches(txn->buffer.patches, txn->buffer.npatches);
+		txn->committed = false;
+	}
+
+	freePatchBuffer(&txn->buffer);
+	txn->failed = false;
 
+	LOGI("[+] transaction rolled back, %d slots restored.", (int)nrestored);
+	return nrestored;
+}
+
+void elfHookEnd(HookTransaction *txn){
+	if(txn){
+		freePatchBuffer(&txn->buffer);
+		free(txn);
+	}
+}
@@ -8,12 +8,248 @@
 #ifndef ELFHOOK_H_
 #define ELFHOOK_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * HookSpec::flags
+ * HOOK_GUARDED: 槽指向生成的保护入口, 替换函数执行期间本线程对该符号的调用直接进入原函数,
+ * 例如替换函数中打日志时liblog对同一符号的调用. 入口检查一位线程局部标记, 已设置时直接跳到原函数,
+ * 否则设置标记后调用替换函数, 返回或有C++异常穿过时清除. 最多转发8个字的栈上参数;
+ * 被longjmp跳出替换函数时标记不会清除, 之后本线程对该符号的调用都进入原函数
+ */
+#define HOOK_GUARDED 0x1
+
+/**
+ * 一个hook请求
+ */
+struct HookSpec {
+	const char *symbol;
+	void *replace_func;
+	void **old_func;
+
+	// 符号版本, 如GLIBC_2.14, NULL表示默认版本
+	const char *version;
+
+	// HOOK_GUARDED等, 0表示直接写入replace_func
+	unsigned flags;
+};
+
+/**
+ * 全局hook中一个模块的结果
+ */
+struct HookResult {
+	const char *soname;
+	void *base;
+	size_t nslots;
+	int status;
+};
 
 /**
  *
  *if soname is NULL, then only found the current process's .rel.plt and .rel.dyn section
+ *version is the symbol version such as GLIBC_2.14, NULL for the default one
+ */
+int elfHook(const char *soname, const char *symbol, void *replace_func, void **old_func, const char *version = NULL);
+
+/**
+ * 同elfHook, 带重入保护, 见HOOK_GUARDED
+ */
+int elfHookGuarded(const char *soname, const char *symbol, void *replace_func, void **old_func, const char *version = NULL);
+
+/**
+ * 重入保护的标记数, HOOK_GUARDED的hook和HookGuard共用
+ */
+#define HOOK_GUARD_MAX 256
+
+/**
+ * 本线程的重入保护标记, 每个id一位
+ * bionic的dlopen不接受initial-exec的TLS, Android上使用默认模型
+ */
+#if defined(__ANDROID__)
+extern __thread uint8_t elf_guard_bits[HOOK_GUARD_MAX / 8];
+#else
+extern __thread uint8_t elf_guard_bits[HOOK_GUARD_MAX / 8] __attribute__((tls_model("initial-exec")));
+#endif
+
+/**
+ * 分配一个HookGuard的id, 与HOOK_GUARDED的hook共用HOOK_GUARD_MAX个, 失败返回-1
+ */
+int elfGuardAlloc();
+
+/**
+ * 替换函数自己持有的重入保护, 只有一次线程局部读取和一次分支, 可以常开在热点符号上
+ * 析构时清除标记, C++异常可以穿过; 被longjmp跳出时标记不会清除
+ *   static int malloc_guard = elfGuardAlloc();
+ *   void *my_malloc(size_t n){
+ *       HookGuard guard(malloc_guard);
+ *       if(guard.nested()) return old_malloc(n);
+ *       ...
+ *   }
+ */
+struct HookGuard {
+	uint8_t *bits;
+	uint8_t mask;
+	bool owner;
+
+	explicit HookGuard(int id) : bits(id >= 0 ? &elf_guard_bits[id >> 3] : NULL), mask(1 << (id & 7)), owner(false){
+		if(bits && !(*bits & mask)){
+			*bits |= mask;
+			owner = true;
+		}
+	}
+
+	~HookGuard(){
+		if(owner){
+			*bits &= ~mask;
+		}
+	}
+
+	// 本线程已经在替换函数中, 或者id分配失败
+	bool nested() const {
+		return !owner;
+	}
+
+	HookGuard(const HookGuard &) = delete;
+	HookGuard &operator=(const HookGuard &) = delete;
+};
+
+/**
+ * 批量hook同一个so中的多个符号, 每个页只修改一次内存属性
+ */
+int elfHookMany(const char *soname, const HookSpec *specs, size_t n);
+
+/**
+ * hook所有已加载模块对symbol的引用, 不导入该符号的模块通过hash表直接跳过
+ * 返回匹配的模块个数, 最多写入nresults个结果
+ */
+int elfHookAll(const char *symbol, void *replace_func, void **old_func, HookResult *results, size_t nresults, const char *version = NULL);
+
+/**
+ * 注册一个全局hook, 立即作用于所有已加载模块,
+ * 之后通过dlopen/android_dlopen_ext加载的模块也会在加载完成后自动hook
+ */
+int elfHookRegister(const char *symbol, void *replace_func, void **old_func, const char *version = NULL);
+
+
+/**
+ * 声明式hook表中的一项, 由ELF_HOOK放入elf_hook_table段
+ */
+struct HookDecl {
+	const char *soname;
+	HookSpec spec;
+};
+
+#define ELF_HOOK_CONCAT_(A, B) A##B
+#define ELF_HOOK_CONCAT(A, B) ELF_HOOK_CONCAT_(A, B)
+
+/**
+ * 声明一个hook, 本so加载时由构造函数收集整个表, 按模块分组后每个模块一次elfHookMany写入
+ * 目标模块必须在本so之前加载, 例如它的依赖或者本so自身. 可选的最后两个参数为version和flags
+ *   ELF_HOOK("libonehook.so", "strlen", my_strlen, &old_strlen);
+ */
+#define ELF_HOOK(SONAME, SYMBOL, REPLACE, OLD, ...) \
+	static HookDecl ELF_HOOK_CONCAT(elf_hook_decl_, __COUNTER__) \
+		__attribute__((used, section("elf_hook_table"), aligned(sizeof(void *)))) = \
+		{SONAME, {SYMBOL, (void *)(REPLACE), (void **)(OLD), ##__VA_ARGS__}}
+
+/**
+ * 使用path作为hook计划缓存, build-id不变的模块直接使用其中记录的GOT偏移,
+ * 跳过符号查找和重定位遍历, 文件不存在或已损坏时重新记录. 只能调用一次
+ */
+int elfHookLoadPlan(const char *path);
+
+/**
+ * 把本次新扫描得到的计划合并写回elfHookLoadPlan指定的文件
  */
-int elfHook(const char *soname, const char *symbol, void *replace_func, void **old_func);
+int elfHookSavePlan();
 
+struct HookStats;
+
+/**
+ * 插桩模式, 不需要替换函数, soname对symbol的调用经过生成的包装代码,
+ * 按线程分片记录调用次数和延迟. 返回统计id, 失败返回-1
+ * 包装代码在自己的栈帧中调用原函数并用周期计数器计时, 最多转发8个字的栈上参数,
+ * 被C++异常或longjmp跳出的调用不计入统计
+ */
+int elfHookInstrument(const char *soname, const char *symbol, const char *version = NULL);
+
+/**
+ * 合并id的所有线程分片, 得到此刻的统计
+ */
+int elfHookSnapshot(int id, HookStats *stats);
+
+/**
+ * 插桩hook每次调用时通过elfTraceEvent记录前nargs个整数参数, 0表示不记录
+ * 参数只取自寄存器, arm最多4个, 其他架构最多TRACE_MAX_ARGS个
+ */
+int elfHookTrace(int id, int nargs);
+
+/**
+ * hook链中的一层
+ */
+struct HookLink;
+
+/**
+ * 在soname对symbol的hook链中加入一层, priority小的先被调用, 相同时按加入顺序
+ * next由引擎维护, 始终指向下一层或原函数, 替换函数直接调用*next. 失败返回NULL
+ * 同一个符号的多个hook互不覆盖, 不要再对链中的符号使用elfHook
+ */
+HookLink *elfHookChain(const char *soname, const char *symbol, void *replace_func, void **next, int priority = 0, const char *version = NULL);
+
+/**
+ * 从链中摘除一层, 上一层的next改为指向它的下一层, 正在经过它的调用不受影响
+ * 调用之后不要释放它的next, 可能还有线程正在使用
+ */
+int elfUnhookChain(HookLink *link);
+
+/**
+ * 按地址hook, soname可写段中所有等于target的函数指针都改为replace_func, 一次全部写入
+ * 包括R_ARM_ABS32等初始化的全局函数指针和运行时保存的函数指针, 不依赖符号名
+ * old_func可以为NULL, 它自身不会被修改. 模块中其他保存target的变量同样会被修改,
+ * 例如别的hook保存的原函数. 返回修改的个数, 失败返回-1
+ */
+int elfHookAddress(const char *soname, void *target, void *replace_func, void **old_func = NULL);
+
+/**
+ * 把soname中所有指向replace_func的hook恢复为原值, 包括elfHook写入的槽, 返回恢复的个数
+ */
+int elfUnhookAddress(const char *soname, void *replace_func);
+
+/**
+ * 恢复soname中symbol的所有槽为hook前的值, 返回恢复的槽个数
+ */
+int elfUnhook(const char *soname, const char *symbol, const char *version = NULL);
+
+/**
+ * hook事务, 事务中的所有槽要么全部写入, 要么全部恢复
+ */
+struct HookTransaction;
+
+/**
+ * 开始一个事务
+ */
+HookTransaction *elfHookBegin();
+
+/**
+ * 向事务中加入soname的一组hook, 只解析不写入
+ * 有符号找不到或者没有槽时事务失败, 返回-1
+ */
+int elfHookTxnAdd(HookTransaction *txn, const char *soname, const HookSpec *specs, size_t n);
+
+/**
+ * 写入事务中的所有槽, 任何一个失败则全部恢复
+ */
+int elfHookCommit(HookTransaction *txn);
+
+/**
+ * 撤销已提交的事务, 槽恢复为提交前的值, 之前的hook仍然有效. 返回恢复的槽个数, 之后可以重新加入hook
+ */
+int elfHookRollback(HookTransaction *txn);
+
+/**
+ * 释放事务, 不会撤销已写入的槽
+ */
+void elfHookEnd(HookTransaction *txn);
 
 #endif /* ELFHOOK_H_ */
@@ -0,0 +1,49 @@
+/*
+ * elfhookt.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFHOOKT_H_
+#define ELFHOOKT_H_
+
+#include "elfhook.h"
+
+/**
+ * 类型安全的hook, Target为被hook的函数, Replace为替换函数, 每对(Target, Replace)有自己的静态原函数槽original
+ * 同一个Target可以有多个不同Replace的hook, 它们的original互不覆盖
+ * 替换函数的类型必须和Target完全相同, 签名不符时编译失败
+ *   size_t my_strlen(const char *str);
+ *   typedef ElfHookT<decltype(strlen), strlen, my_strlen> StrlenHook;
+ *   StrlenHook::install("libonehook.so", "strlen");
+ *   size_t len = StrlenHook::original(str);
+ */
+template<typename F, F *Target, F *Replace>
+struct ElfHookT {
+	typedef F *Func;
+
+	// 地址在链接时确定, 调用原函数只需一次load, 不需要查表
+	static Func original;
+
+	static int install(const char *soname, const char *symbol, const char *version = NULL, unsigned flags = 0){
+		HookSpec spec = {symbol, (void *)Replace, (void **)&original, version, flags};
+		return elfHookMany(soname, &spec, 1);
+	}
+
+	static int uninstall(const char *soname, const char *symbol, const char *version = NULL){
+		return elfUnhook(soname, symbol, version);
+	}
+};
+
+template<typename F, F *Target, F *Replace>
+typename ElfHookT<F, Target, Replace>::Func ElfHookT<F, Target, Replace>::original = NULL;
+
+/**
+ * ELF_HOOK_T(strlen, my_strlen)即ElfHookT<decltype(strlen), strlen, my_strlen>
+ * elfHookT(soname, strlen, my_strlen)用函数名作为符号名安装
+ */
+#define ELF_HOOK_T(F, REPLACE) ElfHookT<decltype(F), F, REPLACE>
+#define elfHookT(SONAME, F, REPLACE) ELF_HOOK_T(F, REPLACE)::install(SONAME, #F)
+
+#endif /* ELFHOOKT_H_ */
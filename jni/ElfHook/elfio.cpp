@@ -12,13 +12,24 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <link.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// getauxval appeared in android-18
+#if !defined(__ANDROID__) || __ANDROID_API__ >= 18
+#define HAVE_GETAUXVAL 1
+#include <sys/auxv.h>
+#else
+#define HAVE_GETAUXVAL 0
+#endif
 
 #include "common.h"
 #include "elfio.h"
 
 ElfHandle *openElfByFile(const char *path) {
 	void *base = NULL;
-	int fd = open(path, O_RDWR);
+	int fd = open(path, O_RDONLY);
 	if (fd < 0) {
 		LOGE("[-] open %s fails.\n", path);
 		exit(-1);
@@ -27,6 +38,7 @@ ElfHandle *openElfByFile(const char *path) {
 	struct stat fs;
 	fstat(fd, &fs);
 
+	// private and writable, changes never reach the file
 	base = mmap(NULL, fs.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
 	if (base == MAP_FAILED) {
 		LOGE("[-] mmap fails.\n");
@@ -38,54 +50,389 @@ ElfHandle *openElfByFile(const char *path) {
 	handle->base = base;
 	handle->space_size = fs.st_size;
 	handle->fromfile = true;
+	handle->phdr = NULL;
+	handle->phnum = 0;
+	handle->fd = -1;
+	handle->regions = NULL;
 
 	return handle;
 }
 
+ElfHandle *openElfByFileLazy(const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LOGE("[-] open %s fails.\n", path);
+		return NULL;
+	}
+
+	struct stat fs;
+	if (fstat(fd, &fs) < 0) {
+		LOGE("[-] fstat %s fails.\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	ElfHandle *handle = (ElfHandle *) malloc(sizeof(ElfHandle));
+	handle->base = NULL;
+	handle->space_size = fs.st_size;
+	handle->fromfile = true;
+	handle->phdr = NULL;
+	handle->phnum = 0;
+	handle->fd = fd;
+	handle->regions = NULL;
+
+	return handle;
+}
+
+static inline bool inFile(const ElfHandle *handle, off_t offset, size_t size){
+	return offset >= 0 && (size_t)offset <= handle->space_size && size <= handle->space_size - offset;
+}
+
+static void addRegion(ElfHandle *handle, void *addr, size_t size, bool mapped){
+	ElfRegion *region = (ElfRegion *) malloc(sizeof(ElfRegion));
+	region->addr = addr;
+	region->size = size;
+	region->mapped = mapped;
+	region->next = handle->regions;
+	handle->regions = region;
+}
+
+void *readElfFile(ElfHandle *handle, off_t offset, size_t size){
+	if(handle->fd < 0 || !inFile(handle, offset, size)){
+		return NULL;
+	}
+
+	uint8_t *buffer = (uint8_t *) malloc(size ? size : 1);
+	size_t done = 0;
+
+	while(done < size){
+		ssize_t n = pread(handle->fd, buffer + done, size - done, offset + done);
+		if(n <= 0){
+			LOGE("[-] pread at 0x%lx fails.\n", (unsigned long)(offset + done));
+			free(buffer);
+			return NULL;
+		}
+		done += n;
+	}
+
+	addRegion(handle, buffer, size, false);
+	return buffer;
+}
+
+const void *mapElfFile(ElfHandle *handle, off_t offset, size_t size, int advice){
+	if(handle->fd < 0 || !size || !inFile(handle, offset, size)){
+		return NULL;
+	}
+
+	off_t start = offset & ~((off_t)getpagesize() - 1);
+	size_t length = size + (offset - start);
+
+	void *addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, handle->fd, start);
+	if(addr == MAP_FAILED){
+		LOGE("[-] mmap at 0x%lx fails.\n", (unsigned long)offset);
+		return NULL;
+	}
+
+	madvise(addr, length, advice);
+
+	addRegion(handle, addr, length, true);
+	return (uint8_t *)addr + (offset - start);
+}
+
 void closeElfByFile(ElfHandle *handle) {
 	if (handle) {
 		if (handle->base && handle->space_size > 0) {
-			msync(handle->base, handle->space_size, MS_SYNC);
 			munmap(handle->base, handle->space_size);
-			free(handle);
 		}
+
+		ElfRegion *region = handle->regions;
+		while (region) {
+			ElfRegion *next = region->next;
+			if (region->mapped) {
+				munmap(region->addr, region->size);
+			} else {
+				free(region->addr);
+			}
+			free(region);
+			region = next;
+		}
+
+		if (handle->fd >= 0) {
+			close(handle->fd);
+		}
+
+		free(handle);
 	}
 }
 
 /**
- * 查找soname的基址，如果为NULL，则为当前进程基址
+ * 带加载计数的dl_phdr_info, 旧的头文件没有这两项
+ * bionic从Android 11才填写, 以回调的size判断是否存在
  */
-static void *findLibBase(const char *soname) {
-	FILE *fd = fopen("/proc/self/maps", "r");
-	char line[256];
-	void *base = 0;
-
-	while (fgets(line, sizeof(line), fd) != NULL) {
-		if (soname == NULL || strstr(line, soname)) {
-			line[8] = '\0';
-			base = (void *) strtoul(line, NULL, 16);
+struct ElfPhdrInfo {
+	uintptr_t dlpi_addr;
+	const char *dlpi_name;
+	const void *dlpi_phdr;
+	uint16_t dlpi_phnum;
+
+	unsigned long long dlpi_adds;
+	unsigned long long dlpi_subs;
+};
+
+/**
+ * 模块表快照, 刷新时生成新的快照, 旧快照在最后一个使用者释放后销毁
+ */
+struct ElfLibTable {
+	ElfLibInfo *libs;
+	size_t nlibs;
+	size_t capacity;
+
+	// open addressing by basename, stores index + 1
+	uint32_t *index;
+	uint32_t mask;
+
+	size_t exe;
+
+	unsigned long long adds;
+	unsigned long long subs;
+
+	int refs;
+};
+
+static ElfLibTable *libtable = NULL;
+static pthread_mutex_t libtable_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// serial of the last module seen
+static uint32_t libserial = 0;
+
+static inline uint32_t hashName(const char *name){
+	uint32_t h = 5381;
+	while(*name){
+		h = (h << 5) + h + (unsigned char)*name++;
+	}
+	return h;
+}
+
+static inline const char *getBasename(const char *name){
+	const char *slash = strrchr(name, '/');
+	return slash ? slash + 1 : name;
+}
+
+/**
+ * data为{adds, subs, 是否有效}
+ */
+static int readLoadCounters(struct dl_phdr_info *info, size_t size, void *data){
+	unsigned long long *counters = (unsigned long long *)data;
+
+	if(size >= offsetof(ElfPhdrInfo, dlpi_subs) + sizeof(((ElfPhdrInfo *)info)->dlpi_subs)){
+		counters[0] = ((ElfPhdrInfo *)info)->dlpi_adds;
+		counters[1] = ((ElfPhdrInfo *)info)->dlpi_subs;
+		counters[2] = 1;
+	}
+
+	// the counters are the same for every entry
+	return 1;
+}
+
+static int collectLibInfo(struct dl_phdr_info *info, size_t size, void *data){
+	ElfLibTable *table = (ElfLibTable *)data;
+
+	if(table->nlibs == table->capacity){
+		table->capacity = table->capacity ? table->capacity * 2 : 64;
+		table->libs = (ElfLibInfo *) realloc(table->libs, sizeof(ElfLibInfo) * table->capacity);
+	}
+
+	ElfLibInfo &lib = table->libs[table->nlibs++];
+	lib.name = strdup(info->dlpi_name ? info->dlpi_name : "");
+	lib.basename = getBasename(lib.name);
+	lib.bias = info->dlpi_addr;
+	lib.phdr = info->dlpi_phdr;
+	lib.phnum = info->dlpi_phnum;
+	lib.hash = hashName(lib.basename);
+
+	return 0;
+}
+
+static void freeLibTable(ElfLibTable *table){
+	for(size_t i = 0; i < table->nlibs; i++){
+		free((void *)table->libs[i].name);
+	}
+	free(table->libs);
+	free(table->index);
+	free(table);
+}
+
+static void buildLibIndex(ElfLibTable &table){
+	uint32_t size = 16;
+	while(size < table.nlibs * 2){
+		size <<= 1;
+	}
+
+	table.index = (uint32_t *) calloc(size, sizeof(uint32_t));
+	table.mask = size - 1;
+
+	for(size_t i = 0; i < table.nlibs; i++){
+		uint32_t slot = table.libs[i].hash & table.mask;
+		while(table.index[slot]){
+			slot = (slot + 1) & table.mask;
+		}
+		table.index[slot] = i + 1;
+	}
+}
+
+static const ElfLibInfo *findLibInfoByHash(const ElfLibTable &table, const char *name, uint32_t hash, bool fullpath){
+	for(uint32_t slot = hash & table.mask; table.index[slot]; slot = (slot + 1) & table.mask){
+		const ElfLibInfo *lib = table.libs + table.index[slot] - 1;
+
+		if(lib->hash == hash && !strcmp(fullpath ? lib->name : lib->basename, name)){
+			return lib;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * 模块在第一次出现时分配一个递增的serial, 之后刷新时保持不变
+ * 两次刷新之间有模块卸载, 或者没有计数器时, 无法区分原地重新加载的模块, 所有模块都分配新的serial
+ */
+static void assignSerials(ElfLibTable &table, const ElfLibTable *old, bool valid){
+	// a module dlclosed and dlopened again may come back at the same address
+	if(!valid || (old && old->subs != table.subs)){
+		old = NULL;
+	}
+
+	for(size_t i = 0; i < table.nlibs; i++){
+		ElfLibInfo &lib = table.libs[i];
+		const ElfLibInfo *prev = NULL;
+
+		if(old){
+			prev = findLibInfoByHash(*old, lib.name, lib.hash, true);
+		}
+
+		if(prev && prev->bias == lib.bias && prev->phdr == lib.phdr){
+			lib.serial = prev->serial;
+		}else{
+			lib.serial = ++libserial;
+		}
+	}
+}
+
+static void findExecutable(ElfLibTable &table){
+	table.exe = 0;
+
+#if HAVE_GETAUXVAL
+	const void *phdr = (const void *)getauxval(AT_PHDR);
+	for(size_t i = 0; i < table.nlibs; i++){
+		if(table.libs[i].phdr == phdr){
+			table.exe = i;
 			break;
 		}
 	}
+#else
+	// the executable is the entry without a name
+	for(size_t i = 0; i < table.nlibs; i++){
+		if(!table.libs[i].name[0]){
+			table.exe = i;
+			break;
+		}
+	}
+#endif
+}
+
+/**
+ * 只有在有模块加载或卸载时才重新遍历, 调用者持有libtable_lock
+ */
+static void refreshLibTable(){
+	unsigned long long counters[3] = {0, 0, 0};
+	dl_iterate_phdr(readLoadCounters, counters);
+
+	// without the counters the table is rebuilt every time
+	if(libtable && counters[2] && counters[0] == libtable->adds && counters[1] == libtable->subs){
+		return;
+	}
+
+	ElfLibTable *table = (ElfLibTable *) calloc(1, sizeof(ElfLibTable));
+	table->adds = counters[0];
+	table->subs = counters[1];
+	table->refs = 1;
+
+	dl_iterate_phdr(collectLibInfo, table);
+	buildLibIndex(*table);
+	assignSerials(*table, libtable, counters[2] != 0);
+	findExecutable(*table);
+
+	ElfLibTable *old = libtable;
+	__atomic_store_n(&libtable, table, __ATOMIC_RELEASE);
+
+	if(old){
+		releaseLibTable(old);
+	}
+}
+
+const ElfLibTable *acquireLibTable(){
+	pthread_mutex_lock(&libtable_lock);
+
+	refreshLibTable();
+	ElfLibTable *table = libtable;
+	__atomic_add_fetch(&table->refs, 1, __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(&libtable_lock);
+	return table;
+}
+
+void releaseLibTable(const ElfLibTable *table){
+	ElfLibTable *t = const_cast<ElfLibTable *>(table);
+	if(__atomic_sub_fetch(&t->refs, 1, __ATOMIC_ACQ_REL) == 0){
+		freeLibTable(t);
+	}
+}
+
+size_t getLibInfos(const ElfLibTable *table, const ElfLibInfo **libs){
+	*libs = table->libs;
+	return table->nlibs;
+}
+
+const ElfLibInfo *findLibInfo(const ElfLibTable *table, const char *soname){
+	if(!table->nlibs){
+		return NULL;
+	}
 
-	fclose(fd);
-	return base;
+	if(soname == NULL){
+		return table->libs + table->exe;
+	}
+
+	const char *basename = getBasename(soname);
+	return findLibInfoByHash(*table, soname, hashName(basename), basename != soname);
 }
 
 /**
  * 从给定的so中获取基址
  */
 ElfHandle *openElfBySoname(const char *soname){
-	void *base = findLibBase(soname);
-	if(!base){
+	const ElfLibTable *table = acquireLibTable();
+
+	const ElfLibInfo *lib = findLibInfo(table, soname);
+	if(!lib){
 		LOGE("[-] could find %s. \n", soname);
 		exit(-1);
 	}
 
+	ElfHandle *handle = openElfByLibInfo(lib);
+	releaseLibTable(table);
+
+	return handle;
+}
+
+ElfHandle *openElfByLibInfo(const ElfLibInfo *lib){
 	ElfHandle *handle = (ElfHandle *) malloc(sizeof(ElfHandle));
-	handle->base = base;
+	handle->base = (void *)lib->bias;
 	handle->space_size = -1;
 	handle->fromfile = false;
+	handle->phdr = lib->phdr;
+	handle->phnum = lib->phnum;
+	handle->fd = -1;
+	handle->regions = NULL;
 
 	return handle;
 }
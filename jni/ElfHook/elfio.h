@@ -8,10 +8,47 @@
 #ifndef ELFIO_H_
 #define ELFIO_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * 按需映射模式下, 已读取或映射的文件区域
+ */
+struct ElfRegion {
+	ElfRegion *next;
+	void *addr;
+	size_t size;
+	bool mapped;
+};
+
 struct ElfHandle {
 	void *base;
 	size_t space_size;
 	bool fromfile;
+
+	// 已加载模块的程序头, base为load bias
+	const void *phdr;
+	size_t phnum;
+
+	// 按需映射模式, base为NULL, 文件保持打开
+	int fd;
+	ElfRegion *regions;
+};
+
+/**
+ * 已加载模块, 来自dl_iterate_phdr
+ */
+struct ElfLibInfo {
+	const char *name;
+	const char *basename;
+	uintptr_t bias;
+	const void *phdr;
+	size_t phnum;
+	uint32_t hash;
+
+	// 模块第一次被看到时分配的递增序号, 重新加载后会变化
+	uint32_t serial;
 };
 
 /**
@@ -20,7 +57,22 @@ struct ElfHandle {
 ElfHandle *openElfByFile(const char *path);
 
 /**
- * 释放资源
+ * 以只读方式打开ELF, 不映射整个文件, 只在解析时按需读取和映射用到的区域, 失败返回NULL
+ */
+ElfHandle *openElfByFileLazy(const char *path);
+
+/**
+ * 用pread读取文件中的一段, 内存在closeElfByFile时释放, 失败返回NULL
+ */
+void *readElfFile(ElfHandle *handle, off_t offset, size_t size);
+
+/**
+ * 只读映射文件中的一段, advice传给madvise, 返回offset对应的地址, 失败返回NULL
+ */
+const void *mapElfFile(ElfHandle *handle, off_t offset, size_t size, int advice);
+
+/**
+ * 释放资源, 两种打开方式都适用
  */
 void closeElfByFile(ElfHandle *handle);
 
@@ -29,10 +81,40 @@ void closeElfByFile(ElfHandle *handle);
  */
 ElfHandle *openElfBySoname(const char *soname);
 
+/**
+ * 从已加载模块获取ElfHandle, 使用closeElfBySoname释放
+ */
+ElfHandle *openElfByLibInfo(const ElfLibInfo *lib);
+
 /**
  * 释放资源
  */
 void closeElfBySoname(ElfHandle *handle);
 
+/**
+ * 已加载模块表的快照
+ */
+struct ElfLibTable;
+
+/**
+ * 获取当前模块表快照, 必要时先刷新, 用完后调用releaseLibTable
+ */
+const ElfLibTable *acquireLibTable();
+
+/**
+ * 释放模块表快照
+ */
+void releaseLibTable(const ElfLibTable *table);
+
+/**
+ * 获取快照中的所有模块, 返回个数
+ */
+size_t getLibInfos(const ElfLibTable *table, const ElfLibInfo **libs);
+
+/**
+ * 根据soname查找已加载模块, soname可以是文件名或者完整路径, NULL表示当前进程自身
+ */
+const ElfLibInfo *findLibInfo(const ElfLibTable *table, const char *soname);
+
 
 #endif /* ELFIO_H_ */
@@ -0,0 +1,374 @@
+/*
+ * elfmodule.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "common.h"
+#include "elfmodule.h"
+#include "elfguard.h"
+#include "elfpatch.h"
+#include "elfplan.h"
+
+#define SAFE_SET_VALUE(t, v) if(t) *(t) = (v)
+
+static ElfModule *modules = NULL;
+
+static int compareRelSlot(const void *a, const void *b){
+	const ElfRelSlot *l = (const ElfRelSlot *)a;
+	const ElfRelSlot *r = (const ElfRelSlot *)b;
+
+	if(l->symidx != r->symidx){
+		return l->symidx < r->symidx ? -1 : 1;
+	}
+
+	if(l->offset != r->offset){
+		return l->offset < r->offset ? -1 : 1;
+	}
+
+	return 0;
+}
+
+template<class T>
+static inline void addRelSlot(ElfRelSlot *slots, size_t &n, const typename T::Rel &rel, bool plt){
+	uint32_t type = T::rType(rel.r_info);
+	uint32_t symidx = T::rSym(rel.r_info);
+
+	if(symidx == 0){
+		return;
+	}
+
+	if(plt && type == T::R_JUMP_SLOT){
+		type = ELF_SLOT_JUMP_SLOT;
+	}else if(!plt && type == T::R_GLOB_DAT){
+		type = ELF_SLOT_GLOB_DAT;
+	}else if(!plt && type == T::R_ABS){
+		type = ELF_SLOT_ABS;
+	}else{
+		return;
+	}
+
+	ElfRelSlot &slot = slots[n++];
+	slot.symidx = symidx;
+	slot.type = type;
+	slot.offset = rel.r_offset;
+}
+
+/**
+ * 一次遍历.rel.plt, .rel.dyn和压缩的.rel.dyn, 只保留可以hook的槽
+ */
+template<class T>
+static void buildRelIndex(ElfModule *module, ElfInfoT<T> &info){
+	PackedRelIterator<T> packed(info.packed_rel, info.packed_relsz);
+
+	size_t n = 0;
+	ElfRelSlot *slots = (ElfRelSlot *) malloc(sizeof(ElfRelSlot) * (info.relpltsz + info.reldynsz + packed.size() + 1));
+
+	for (size_t i = 0; i < info.relpltsz; i++) {
+		addRelSlot<T>(slots, n, info.relplt[i], true);
+	}
+
+	for (size_t i = 0; i < info.reldynsz; i++) {
+		addRelSlot<T>(slots, n, info.reldyn[i], false);
+	}
+
+	// packed relocations are decoded one by one, never expanded
+	typename T::Rel rel;
+	while(packed.next(rel)){
+		addRelSlot<T>(slots, n, rel, false);
+	}
+
+	qsort(slots, n, sizeof(ElfRelSlot), compareRelSlot);
+
+	module->slots = slots;
+	module->nslots = n;
+}
+
+static void freeElfModule(ElfModule *module){
+	pthread_mutex_destroy(&module->lock);
+	closeElfBySoname(module->handle);
+	free(module->info.undef_index);
+	free(module->slots);
+	free(module->soname);
+	free(module);
+}
+
+static ElfModule *findCachedModule(ElfModule *head, ElfModule *stop, const ElfLibInfo *lib){
+	for(ElfModule *module = head; module != stop; module = module->next){
+		if(module->handle->base == (void *)lib->bias && module->handle->phdr == lib->phdr
+				&& !strcmp(module->soname, lib->name)){
+			return module;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * 模块缓存是一个只增不减的无锁链表, 并发构建同一个模块时只保留先发布的一个
+ */
+ElfModule *getElfModuleByLib(const ElfLibInfo *lib){
+	ElfModule *head = __atomic_load_n(&modules, __ATOMIC_ACQUIRE);
+	ElfModule *module = findCachedModule(head, NULL, lib);
+	if(module){
+		return module;
+	}
+
+	ElfHandle *handle = openElfByLibInfo(lib);
+
+	module = (ElfModule *) calloc(1, sizeof(ElfModule));
+	module->soname = strdup(lib->name);
+	module->handle = handle;
+	pthread_mutex_init(&module->lock, NULL);
+
+	getElfInfoBySegmentView(module->info, handle);
+
+	module->next = head;
+	while(!__atomic_compare_exchange_n(&modules, &module->next, module, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)){
+		// only the modules published since our last look need to be checked
+		ElfModule *other = findCachedModule(module->next, head, lib);
+		if(other){
+			freeElfModule(module);
+			return other;
+		}
+		head = module->next;
+	}
+
+	LOGI("[+] module %s at %p.", module->soname, handle->base);
+	return module;
+}
+
+ElfModule *getElfModule(const char *soname){
+	const ElfLibTable *table = acquireLibTable();
+
+	ElfModule *module = NULL;
+	const ElfLibInfo *lib = findLibInfo(table, soname);
+	if(lib){
+		module = getElfModuleByLib(lib);
+	}else{
+		LOGE("[-] could find %s. \n", soname);
+	}
+
+	releaseLibTable(table);
+	return module;
+}
+
+void flushElfModules(){
+	ElfModule *module = __atomic_exchange_n(&modules, (ElfModule *)NULL, __ATOMIC_ACQ_REL);
+
+	while(module){
+		ElfModule *next = module->next;
+		freeElfModule(module);
+		module = next;
+	}
+}
+
+static void ensureRelIndex(ElfModule *module){
+	if(__atomic_load_n(&module->indexed, __ATOMIC_ACQUIRE)){
+		return;
+	}
+
+	pthread_mutex_lock(&module->lock);
+	if(!module->indexed){
+		buildRelIndex(module, module->info);
+		__atomic_store_n(&module->indexed, true, __ATOMIC_RELEASE);
+
+		LOGI("[+] module %s, %d slots.", module->soname, (int)module->nslots);
+	}
+	pthread_mutex_unlock(&module->lock);
+}
+
+/**
+ * 导入符号的hash表, 每个模块只建立一次, elfHookAll对不导入该符号的模块不再线性遍历
+ */
+static void ensureUndefIndex(ElfModule *module){
+	if(__atomic_load_n(&module->undef_indexed, __ATOMIC_ACQUIRE)){
+		return;
+	}
+
+	pthread_mutex_lock(&module->lock);
+	if(!module->undef_indexed){
+		buildUndefIndex(module->info);
+		__atomic_store_n(&module->undef_indexed, true, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&module->lock);
+}
+
+size_t findRelSlots(ElfModule *module, uint32_t symidx, const ElfRelSlot **slots){
+	ensureRelIndex(module);
+
+	size_t lo = 0, hi = module->nslots;
+
+	// lower bound of symidx
+	while(lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+		if(module->slots[mid].symidx < symidx){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+
+	size_t end = lo;
+	while(end < module->nslots && module->slots[end].symidx == symidx){
+		end++;
+	}
+
+	*slots = module->slots + lo;
+	return end - lo;
+}
+
+/**
+ * 计划中的偏移必须落在模块的某个PT_LOAD中, 否则认为计划已经失效
+ */
+static bool checkPlannedSlots(const ElfModule *module, const uint64_t *offsets, size_t count){
+	const ElfInfo &info = module->info;
+
+	for(size_t i = 0; i < count; i++){
+		bool found = false;
+		for(int j = 0; j < info.phnum && !found; j++){
+			const ElfNative::Phdr &phdr = info.phdr[j];
+			found = phdr.p_type == PT_LOAD && offsets[i] >= phdr.p_vaddr
+					&& offsets[i] + sizeof(void *) <= phdr.p_vaddr + phdr.p_memsz;
+		}
+
+		if(!found){
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * 带版本的查询在hook计划中使用symbol@version作为名字
+ */
+static char *getPlanName(const char *symbol, const char *version){
+	size_t len = strlen(symbol);
+	char *name = (char *) malloc(len + strlen(version) + 2);
+
+	memcpy(name, symbol, len);
+	name[len] = '@';
+	strcpy(name + len + 1, version);
+	return name;
+}
+
+bool findSymSlots(ElfModule *module, const char *symbol, const char *version, ElfSymSlots *result){
+	const ElfInfo &info = module->info;
+
+	result->planned = NULL;
+	result->slots = NULL;
+	result->count = 0;
+
+	char *planname = version && info.build_id ? getPlanName(symbol, version) : NULL;
+	const char *name = planname ? planname : symbol;
+
+	const uint64_t *offsets = NULL;
+	size_t count = 0;
+	uint32_t flags = 0;
+	if(findElfPlan(info.build_id, info.build_idsz, name, &offsets, &count, &flags)){
+		if(checkPlannedSlots(module, offsets, count)){
+			result->planned = offsets;
+			result->count = count;
+
+			free(planname);
+			return !(flags & ELF_PLAN_MISSING);
+		}
+		LOGW("[-] hook plan of %s in %s is stale.", name, module->soname);
+	}
+
+	int symidx = 0;
+	ensureUndefIndex(module);
+	findSymByName(module->info, symbol, (ElfSym **)NULL, &symidx, version);
+
+	if(symidx > 0){
+		result->count = findRelSlots(module, symidx, &result->slots);
+		LOGI("[+] %s symidx %d, %d slots.", name, symidx, (int)result->count);
+	}
+
+	if(info.build_id){
+		uintptr_t *scanned = (uintptr_t *) malloc(sizeof(uintptr_t) * (result->count + 1));
+		for(size_t i = 0; i < result->count; i++){
+			scanned[i] = result->slots[i].offset;
+		}
+
+		addElfPlan(info.build_id, info.build_idsz, module->soname, name, scanned, result->count, symidx > 0 ? 0 : ELF_PLAN_MISSING);
+		free(scanned);
+	}
+
+	free(planname);
+	return symidx > 0;
+}
+
+size_t collectSymSlotPatches(ElfModule *module, const HookSpec *spec, const ElfSymSlots *slots, ElfPatchBuffer *buffer){
+	assert(spec->replace_func);
+	assert(spec->old_func);
+
+	// guarded hooks put their entry in the slots instead of replace_func
+	void *func = spec->replace_func;
+	if(spec->flags & HOOK_GUARDED){
+		func = getGuardThunk(spec->replace_func, spec->old_func);
+		if(!func){
+			return 0;
+		}
+	}
+
+	size_t count = 0;
+	for(size_t j = 0; j < slots->count; j++){
+		void **addr = getSymSlotAddr(module, slots, j);
+
+		if(*addr == func){
+			LOGW("addr %p had been replace.", addr);
+			continue;
+		}
+
+		addPatch(buffer, addr, func, spec->old_func);
+		count++;
+
+		LOGI("[+] addr %p, replace_func is %p.", addr, func);
+	}
+
+	return count;
+}
+
+size_t collectElfModulePatches(ElfModule *module, const HookSpec *specs, size_t n, ElfPatchBuffer *buffer, bool report_missing, size_t *nmissing){
+	size_t count = 0;
+	size_t missing = 0;
+
+	for(size_t i = 0; i < n; i++){
+		const HookSpec &spec = specs[i];
+
+		assert(spec.symbol);
+
+		ElfSymSlots slots;
+		if(!findSymSlots(module, spec.symbol, spec.version, &slots) || !slots.count){
+			if(report_missing){
+				LOGE("[-] Could not find symbol %s@%s", spec.symbol, spec.version ? spec.version : "");
+			}
+			missing++;
+			continue;
+		}
+
+		count += collectSymSlotPatches(module, &spec, &slots, buffer);
+	}
+
+	SAFE_SET_VALUE(nmissing, missing);
+	return count;
+}
+
+int hookElfModule(ElfModule *module, const HookSpec *specs, size_t n, size_t *npatched, bool report_missing){
+	ElfPatchBuffer buffer = {NULL, 0, 0};
+
+	collectElfModulePatches(module, specs, n, &buffer, report_missing);
+
+	int res = applyPatches(&buffer);
+	SAFE_SET_VALUE(npatched, res ? 0 : buffer.npatches);
+
+	freePatchBuffer(&buffer);
+	return res;
+}
@@ -0,0 +1,123 @@
+/*
+ * elfmodule.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFMODULE_H_
+#define ELFMODULE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "elfio.h"
+#include "elfutils.h"
+#include "elfhook.h"
+#include "elfpatch.h"
+
+/**
+ * 重定位槽的类型
+ */
+enum {
+	ELF_SLOT_JUMP_SLOT = 0,
+	ELF_SLOT_GLOB_DAT = 1,
+	ELF_SLOT_ABS = 2
+};
+
+/**
+ * 一个可以被hook的重定位槽, 按(symidx, offset)排序
+ */
+struct ElfRelSlot {
+	uint32_t symidx;
+	uint32_t type;
+	uintptr_t offset;
+};
+
+/**
+ * 缓存的模块描述, 第一次使用时解析PT_DYNAMIC, 符号索引到重定位槽的索引在第一次需要时才建立
+ */
+struct ElfModule {
+	ElfModule *next;
+
+	char *soname;
+	ElfHandle *handle;
+	ElfInfo info;
+
+	// built by the first findRelSlots, hook plan hits never need it
+	pthread_mutex_t lock;
+	bool indexed;
+	ElfRelSlot *slots;
+	size_t nslots;
+
+	// info.undef_index, built by the first symbol lookup
+	bool undef_indexed;
+};
+
+/**
+ * 一个符号在模块中的所有槽, 来自hook计划缓存或者重定位索引
+ */
+struct ElfSymSlots {
+	const uint64_t *planned;
+	const ElfRelSlot *slots;
+	size_t count;
+};
+
+/**
+ * 获取缓存的模块描述, 如果soname为NULL，则表示当前进程自身, 找不到时返回NULL
+ */
+ElfModule *getElfModule(const char *soname);
+
+/**
+ * 获取已加载模块的缓存描述
+ */
+ElfModule *getElfModuleByLib(const ElfLibInfo *lib);
+
+/**
+ * 清空模块缓存, 不是线程安全的, 只能在没有其他hook操作时调用
+ */
+void flushElfModules();
+
+/**
+ * 查找symidx对应的重定位槽, 返回个数
+ */
+size_t findRelSlots(ElfModule *module, uint32_t symidx, const ElfRelSlot **slots);
+
+/**
+ * 获取重定位槽的地址
+ */
+static inline void **getRelSlotAddr(const ElfModule *module, const ElfRelSlot *slot){
+	return (void **)(module->info.elf_base + slot->offset);
+}
+
+/**
+ * 查找symbol在模块中的所有槽, 优先使用hook计划缓存, 符号不存在时返回false, version可以为NULL
+ */
+bool findSymSlots(ElfModule *module, const char *symbol, const char *version, ElfSymSlots *result);
+
+/**
+ * 获取符号的第i个槽的地址
+ */
+static inline void **getSymSlotAddr(const ElfModule *module, const ElfSymSlots *slots, size_t i){
+	uintptr_t offset = slots->planned ? (uintptr_t)slots->planned[i] : slots->slots[i].offset;
+	return (void **)(module->info.elf_base + offset);
+}
+
+/**
+ * 收集已经找到的一个符号的槽, 返回个数
+ */
+size_t collectSymSlotPatches(ElfModule *module, const HookSpec *spec, const ElfSymSlots *slots, ElfPatchBuffer *buffer);
+
+/**
+ * 收集hook一个模块需要写入的槽, 返回个数
+ * nmissing不为NULL时返回找不到符号或者没有槽的spec个数
+ */
+size_t collectElfModulePatches(ElfModule *module, const HookSpec *specs, size_t n, ElfPatchBuffer *buffer, bool report_missing, size_t *nmissing = NULL);
+
+/**
+ * hook一个模块, npatched返回修改的槽个数
+ */
+int hookElfModule(ElfModule *module, const HookSpec *specs, size_t n, size_t *npatched, bool report_missing);
+
+#endif /* ELFMODULE_H_ */
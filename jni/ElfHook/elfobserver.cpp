@@ -0,0 +1,169 @@
+/*
+ * elfobserver.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "elfhook.h"
+#include "elfio.h"
+#include "elfmodule.h"
+
+typedef void *(*dlopen_fun)(const char *, int);
+typedef void *(*android_dlopen_ext_fun)(const char *, int, const void *);
+
+// bionic N+ use the caller address to pick the linker namespace
+typedef void *(*loader_dlopen_fun)(const char *, int, const void *);
+typedef void *(*loader_android_dlopen_ext_fun)(const char *, int, const void *, const void *);
+
+static dlopen_fun old_dlopen = NULL;
+static android_dlopen_ext_fun old_android_dlopen_ext = NULL;
+static loader_dlopen_fun loader_dlopen = NULL;
+static loader_android_dlopen_ext_fun loader_android_dlopen_ext = NULL;
+
+/**
+ * 已注册的hook, 会应用到之后加载的每个模块
+ */
+struct HookRegistry {
+	HookSpec *specs;
+	size_t nspecs;
+	size_t capacity;
+
+	// modules with a serial <= last_serial have been processed
+	uint32_t last_serial;
+	bool observing;
+};
+
+static HookRegistry registry;
+
+// only taken on the hook install and dlopen path, never by hooked calls
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void addRegistry(const char *symbol, void *replace_func, void **old_func, const char *version){
+	if(registry.nspecs == registry.capacity){
+		registry.capacity = registry.capacity ? registry.capacity * 2 : 16;
+		registry.specs = (HookSpec *) realloc(registry.specs, sizeof(HookSpec) * registry.capacity);
+	}
+
+	HookSpec &spec = registry.specs[registry.nspecs++];
+	spec.symbol = strdup(symbol);
+	spec.replace_func = replace_func;
+	spec.old_func = old_func;
+	spec.version = version ? strdup(version) : NULL;
+	spec.flags = 0;
+}
+
+/**
+ * 只处理serial大于last_serial的模块, 包括原地重新加载的模块
+ * 已经hook过的槽不会再写入
+ */
+static void onModulesLoaded(){
+	pthread_mutex_lock(&registry_lock);
+
+	const ElfLibTable *table = acquireLibTable();
+	const ElfLibInfo *libs = NULL;
+	size_t nlibs = getLibInfos(table, &libs);
+	uint32_t last_serial = registry.last_serial;
+
+	for(size_t i = 0; i < nlibs; i++){
+		const ElfLibInfo &lib = libs[i];
+		if(lib.serial <= registry.last_serial){
+			continue;
+		}
+
+		if(lib.serial > last_serial){
+			last_serial = lib.serial;
+		}
+
+		ElfModule *module = getElfModuleByLib(&lib);
+		size_t npatched = 0;
+		hookElfModule(module, registry.specs, registry.nspecs, &npatched, false);
+
+		LOGI("[+] %s was loaded, %d slots hooked.", lib.name, (int)npatched);
+	}
+
+	registry.last_serial = last_serial;
+
+	releaseLibTable(table);
+	pthread_mutex_unlock(&registry_lock);
+}
+
+static void *my_dlopen(const char *filename, int flag){
+	void *handle = loader_dlopen ?
+			loader_dlopen(filename, flag, __builtin_return_address(0)) :
+			old_dlopen(filename, flag);
+
+	if(handle){
+		onModulesLoaded();
+	}
+	return handle;
+}
+
+static void *my_android_dlopen_ext(const char *filename, int flag, const void *extinfo){
+	void *handle = loader_android_dlopen_ext ?
+			loader_android_dlopen_ext(filename, flag, extinfo, __builtin_return_address(0)) :
+			old_android_dlopen_ext(filename, flag, extinfo);
+
+	if(handle){
+		onModulesLoaded();
+	}
+	return handle;
+}
+
+static void registerHook(const char *symbol, void *replace_func, void **old_func){
+	addRegistry(symbol, replace_func, old_func, NULL);
+	elfHookAll(symbol, replace_func, old_func, NULL, 0);
+}
+
+/**
+ * dlopen本身也是注册的hook, 所以新模块里的dlopen也会被观察
+ */
+static void startObserver(){
+	registry.observing = true;
+
+	old_dlopen = (dlopen_fun) dlsym(RTLD_DEFAULT, "dlopen");
+	old_android_dlopen_ext = (android_dlopen_ext_fun) dlsym(RTLD_DEFAULT, "android_dlopen_ext");
+	loader_dlopen = (loader_dlopen_fun) dlsym(RTLD_DEFAULT, "__loader_dlopen");
+	loader_android_dlopen_ext = (loader_android_dlopen_ext_fun) dlsym(RTLD_DEFAULT, "__loader_android_dlopen_ext");
+
+	// everything mapped now is handled by elfHookAll
+	const ElfLibTable *table = acquireLibTable();
+	const ElfLibInfo *libs = NULL;
+	size_t nlibs = getLibInfos(table, &libs);
+	for(size_t i = 0; i < nlibs; i++){
+		if(libs[i].serial > registry.last_serial){
+			registry.last_serial = libs[i].serial;
+		}
+	}
+	releaseLibTable(table);
+
+	registerHook("dlopen", (void *)my_dlopen, (void **)&old_dlopen);
+	if(old_android_dlopen_ext){
+		registerHook("android_dlopen_ext", (void *)my_android_dlopen_ext, (void **)&old_android_dlopen_ext);
+	}
+}
+
+int elfHookRegister(const char *symbol, void *replace_func, void **old_func, const char *version){
+	assert(old_func);
+	assert(replace_func);
+	assert(symbol);
+
+	pthread_mutex_lock(&registry_lock);
+
+	if(!registry.observing){
+		startObserver();
+	}
+
+	addRegistry(symbol, replace_func, old_func, version);
+	int res = elfHookAll(symbol, replace_func, old_func, NULL, 0, version);
+
+	pthread_mutex_unlock(&registry_lock);
+	return res;
+}
@@ -0,0 +1,350 @@
+/*
+ * elfpatch.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <unistd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "elfpatch.h"
+
+#define PAGE_START(addr) (~(getpagesize() - 1) & (addr))
+
+static int modifyMemAccess(void *addr, int prots){
+	void *page_start_addr = (void *)PAGE_START((uintptr_t)addr);
+	return mprotect(page_start_addr, getpagesize(), prots);
+}
+
+static int clearCache(void *addr, size_t len){
+	void *end = (uint8_t *)addr + len;
+#if defined(__arm__)
+	return syscall(0xf0002, addr, end);
+#else
+	__builtin___clear_cache((char *)addr, (char *)end);
+	return 0;
+#endif
+}
+
+#define PATCH_SHARDS 16
+
+/**
+ * undo log, 按addr排序, prev为第一次hook前的值
+ */
+struct UndoEntry {
+	void **addr;
+	void *prev;
+	void *value;
+};
+
+struct UndoLog {
+	UndoEntry *entries;
+	size_t n;
+	size_t capacity;
+};
+
+/**
+ * 按页分片的锁和undo log, 不同页上的槽可以并发写入
+ */
+struct PatchShard {
+	pthread_mutex_t lock;
+	UndoLog undo;
+};
+
+static PatchShard shards[PATCH_SHARDS];
+static pthread_once_t shards_once = PTHREAD_ONCE_INIT;
+
+static void initShards(){
+	for(int i = 0; i < PATCH_SHARDS; i++){
+		pthread_mutex_init(&shards[i].lock, NULL);
+	}
+}
+
+static inline unsigned getShard(void **addr){
+	return ((uintptr_t)addr / getpagesize()) % PATCH_SHARDS;
+}
+
+/**
+ * 按分片序号从小到大加锁, 避免死锁
+ */
+static uint32_t lockShards(void ***addrs, size_t n, size_t stride){
+	pthread_once(&shards_once, initShards);
+
+	uint32_t mask = 0;
+	for(size_t i = 0; i < n; i++){
+		mask |= 1u << getShard(*(void ***)((uint8_t *)addrs + i * stride));
+	}
+
+	for(int i = 0; i < PATCH_SHARDS; i++){
+		if(mask & (1u << i)){
+			pthread_mutex_lock(&shards[i].lock);
+		}
+	}
+
+	return mask;
+}
+
+static void unlockShards(uint32_t mask){
+	for(int i = PATCH_SHARDS - 1; i >= 0; i--){
+		if(mask & (1u << i)){
+			pthread_mutex_unlock(&shards[i].lock);
+		}
+	}
+}
+
+static int comparePatch(const void *a, const void *b){
+	uintptr_t l = (uintptr_t)((const ElfPatch *)a)->addr;
+	uintptr_t r = (uintptr_t)((const ElfPatch *)b)->addr;
+	return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+static int compareAddr(const void *a, const void *b){
+	uintptr_t l = *(const uintptr_t *)a;
+	uintptr_t r = *(const uintptr_t *)b;
+	return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+static size_t lowerUndo(const UndoLog &log, void **addr){
+	size_t lo = 0, hi = log.n;
+
+	while(lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+		if(log.entries[mid].addr < addr){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static void recordUndo(UndoLog &log, const ElfPatch &patch){
+	size_t pos = lowerUndo(log, patch.addr);
+	if(pos < log.n && log.entries[pos].addr == patch.addr){
+		// hooked again, keep the original value
+		log.entries[pos].value = patch.value;
+		return;
+	}
+
+	if(log.n == log.capacity){
+		log.capacity = log.capacity ? log.capacity * 2 : 64;
+		log.entries = (UndoEntry *) realloc(log.entries, sizeof(UndoEntry) * log.capacity);
+	}
+
+	memmove(log.entries + pos + 1, log.entries + pos, sizeof(UndoEntry) * (log.n - pos));
+	log.n++;
+
+	UndoEntry &entry = log.entries[pos];
+	entry.addr = patch.addr;
+	entry.prev = patch.prev;
+	entry.value = patch.value;
+}
+
+/**
+ * patches必须已排序, 返回处理的个数, 小于n表示mprotect失败
+ * 每个槽都用release store发布, 其他线程不会看到写了一半的指针
+ * swapped非NULL时只在槽仍为prev时写入, 结果记录在swapped中
+ */
+static size_t writePatches(ElfPatch *patches, size_t n, bool *swapped = NULL){
+	size_t i = 0;
+	while(i < n){
+		uintptr_t page = PAGE_START((uintptr_t)patches[i].addr);
+
+		if(modifyMemAccess(patches[i].addr, PROT_EXEC|PROT_READ|PROT_WRITE)){
+			LOGE("[-] modifymemAccess fails, error %s.", strerror(errno));
+			return i;
+		}
+
+		void **first = patches[i].addr;
+		void **last = first;
+		for(; i < n && PAGE_START((uintptr_t)patches[i].addr) == page; i++){
+			if(swapped){
+				void *expected = patches[i].prev;
+				swapped[i] = __atomic_compare_exchange_n(patches[i].addr, &expected, patches[i].value,
+						false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+			}else{
+				__atomic_store_n(patches[i].addr, patches[i].value, __ATOMIC_RELEASE);
+			}
+			last = patches[i].addr;
+		}
+
+		clearCache(first, (uint8_t *)(last + 1) - (uint8_t *)first);
+	}
+
+	return n;
+}
+
+void addPatch(ElfPatchBuffer *buffer, void **addr, void *value, void **old_func){
+	if(buffer->npatches == buffer->capacity){
+		buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 16;
+		buffer->patches = (ElfPatch *) realloc(buffer->patches, sizeof(ElfPatch) * buffer->capacity);
+	}
+
+	ElfPatch &patch = buffer->patches[buffer->npatches++];
+	patch.addr = addr;
+	patch.value = value;
+	patch.prev = NULL;
+	patch.old_func = old_func;
+}
+
+void freePatchBuffer(ElfPatchBuffer *buffer){
+	free(buffer->patches);
+	buffer->patches = NULL;
+	buffer->npatches = 0;
+	buffer->capacity = 0;
+}
+
+int applyPatches(ElfPatchBuffer *buffer){
+	ElfPatch *patches = buffer->patches;
+	size_t n = buffer->npatches;
+
+	qsort(patches, n, sizeof(ElfPatch), comparePatch);
+
+	uint32_t locked = lockShards(&patches[0].addr, n, sizeof(ElfPatch));
+
+	// another thread may have installed the same hook since the slots were collected
+	size_t m = 0;
+	for(size_t i = 0; i < n; i++){
+		patches[i].prev = __atomic_load_n(patches[i].addr, __ATOMIC_ACQUIRE);
+		if(patches[i].prev != patches[i].value){
+			patches[m++] = patches[i];
+		}
+	}
+	n = m;
+	buffer->npatches = m;
+
+	// old_func must be ready before any caller can reach the replacement
+	bool *owned = (bool *) calloc(n + 1, sizeof(bool));
+	for(size_t i = 0; i < n; i++){
+		void *expected = NULL;
+		if(patches[i].old_func){
+			owned[i] = __atomic_compare_exchange_n(patches[i].old_func, &expected, patches[i].prev,
+					false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+		}
+	}
+
+	size_t nwritten = writePatches(patches, n);
+	if(nwritten < n){
+		// those pages are writable already, put the old values back
+		for(size_t i = 0; i < nwritten; i++){
+			__atomic_store_n(patches[i].addr, patches[i].prev, __ATOMIC_RELEASE);
+			clearCache(patches[i].addr, sizeof(void *));
+		}
+
+		for(size_t i = 0; i < n; i++){
+			if(owned[i]){
+				__atomic_store_n(patches[i].old_func, (void *)NULL, __ATOMIC_RELEASE);
+			}
+		}
+
+		unlockShards(locked);
+
+		LOGE("[-] %d of %d slots were rolled back.", (int)nwritten, (int)n);
+		free(owned);
+		buffer->npatches = 0;
+		return 1;
+	}
+
+	for(size_t i = 0; i < n; i++){
+		recordUndo(shards[getShard(patches[i].addr)].undo, patches[i]);
+	}
+
+	unlockShards(locked);
+
+	free(owned);
+	return 0;
+}
+
+size_t restorePatches(void ***addrs, size_t n){
+	ElfPatch *patches = (ElfPatch *) malloc(sizeof(ElfPatch) * (n + 1));
+	size_t npatches = 0;
+
+	qsort(addrs, n, sizeof(void **), compareAddr);
+	uint32_t locked = lockShards(addrs, n, sizeof(void **));
+
+	for(size_t i = 0; i < n; i++){
+		UndoLog &log = shards[getShard(addrs[i])].undo;
+
+		size_t pos = lowerUndo(log, addrs[i]);
+		if(pos >= log.n || log.entries[pos].addr != addrs[i]){
+			continue;
+		}
+
+		UndoEntry &entry = log.entries[pos];
+		void *current = __atomic_load_n(entry.addr, __ATOMIC_ACQUIRE);
+
+		if(current != entry.value){
+			LOGW("[*] addr %p was replaced by %p, skip it.", entry.addr, current);
+		}else{
+			ElfPatch &patch = patches[npatches++];
+			patch.addr = entry.addr;
+			patch.value = entry.prev;
+			patch.prev = entry.value;
+			patch.old_func = NULL;
+		}
+
+		memmove(log.entries + pos, log.entries + pos + 1, sizeof(UndoEntry) * (log.n - pos - 1));
+		log.n--;
+	}
+
+	size_t nrestored = writePatches(patches, npatches);
+	unlockShards(locked);
+
+	free(patches);
+	return nrestored;
+}
+
+size_t revertPatches(const ElfPatch *patches, size_t n){
+	// the reverse writes, expected to still hold what was written
+	ElfPatch *reverts = (ElfPatch *) malloc(sizeof(ElfPatch) * (n + 1));
+	for(size_t i = 0; i < n; i++){
+		reverts[i].addr = patches[i].addr;
+		reverts[i].value = patches[i].prev;
+		reverts[i].prev = patches[i].value;
+		reverts[i].old_func = NULL;
+	}
+
+	qsort(reverts, n, sizeof(ElfPatch), comparePatch);
+	uint32_t locked = lockShards(&reverts[0].addr, n, sizeof(ElfPatch));
+
+	bool *swapped = (bool *) calloc(n + 1, sizeof(bool));
+	size_t nwritten = writePatches(reverts, n, swapped);
+
+	size_t nreverted = 0;
+	for(size_t i = 0; i < nwritten; i++){
+		if(!swapped[i]){
+			LOGW("[*] addr %p was replaced since the commit, skip it.", reverts[i].addr);
+			continue;
+		}
+		nreverted++;
+
+		// the slot may still be hooked by someone else, keep the log in step with it
+		UndoLog &log = shards[getShard(reverts[i].addr)].undo;
+		size_t pos = lowerUndo(log, reverts[i].addr);
+		if(pos >= log.n || log.entries[pos].addr != reverts[i].addr){
+			continue;
+		}
+
+		if(log.entries[pos].prev == reverts[i].value){
+			memmove(log.entries + pos, log.entries + pos + 1, sizeof(UndoEntry) * (log.n - pos - 1));
+			log.n--;
+		}else{
+			log.entries[pos].value = reverts[i].value;
+		}
+	}
+
+	unlockShards(locked);
+
+	free(swapped);
+	free(reverts);
+	return nreverted;
+}
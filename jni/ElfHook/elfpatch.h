@@ -0,0 +1,64 @@
+/*
+ * elfpatch.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFPATCH_H_
+#define ELFPATCH_H_
+
+#include <stddef.h>
+
+/**
+ * 一次槽写入
+ */
+struct ElfPatch {
+	void **addr;
+	void *value;
+
+	// 写入前的值, 由applyPatches填充
+	void *prev;
+
+	// 非NULL且*old_func为NULL时, 写入前用原值初始化
+	void **old_func;
+};
+
+/**
+ * 可增长的ElfPatch数组
+ */
+struct ElfPatchBuffer {
+	ElfPatch *patches;
+	size_t npatches;
+	size_t capacity;
+};
+
+/**
+ * 追加一次槽写入
+ */
+void addPatch(ElfPatchBuffer *buffer, void **addr, void *value, void **old_func);
+
+/**
+ * 释放资源
+ */
+void freePatchBuffer(ElfPatchBuffer *buffer);
+
+/**
+ * 批量写入槽, patches会按地址排序, 每个页只调用一次mprotect和clearCache
+ * 要么全部写入并记录到undo log, 要么全部恢复原值
+ * 已经是目标值的槽从buffer中移除, 返回后npatches为实际写入的个数
+ */
+int applyPatches(ElfPatchBuffer *buffer);
+
+/**
+ * 按undo log把槽恢复为hook前的值, 返回恢复的个数
+ */
+size_t restorePatches(void ***addrs, size_t n);
+
+/**
+ * 撤销一组applyPatches成功写入的patches, 每个槽恢复为它的prev,
+ * 只恢复仍然是value的槽, 不影响之前对同一个槽的hook. 返回恢复的个数
+ */
+size_t revertPatches(const ElfPatch *patches, size_t n);
+
+#endif /* ELFPATCH_H_ */
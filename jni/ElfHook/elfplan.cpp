@@ -0,0 +1,462 @@
+/*
+ * elfplan.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "elfhook.h"
+#include "elfplan.h"
+
+#define PLAN_BUCKETS 1024
+
+/**
+ * 本次运行中新扫描得到的计划, 不会释放, 返回给调用者的偏移一直有效
+ */
+struct PlanRecord {
+	PlanRecord *next;
+
+	uint32_t key;
+	uint8_t build_id[ELF_BUILD_ID_MAX];
+	uint16_t build_idsz;
+	char *soname;
+	char *symbol;
+
+	uint64_t *offsets;
+	size_t count;
+	uint32_t flags;
+};
+
+struct HookPlan {
+	char *path;
+
+	// the mapped plan file, read only and never unmapped
+	const uint8_t *base;
+	size_t size;
+	const ElfPlanEntry *entries;
+	size_t nentries;
+	const uint64_t *offsets;
+	const char *strings;
+
+	PlanRecord *buckets[PLAN_BUCKETS];
+	size_t nrecords;
+};
+
+static HookPlan *plan = NULL;
+static pthread_mutex_t plan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t planKey(const uint8_t *build_id, size_t build_idsz, const char *symbol){
+	uint32_t h = 5381;
+	for(size_t i = 0; i < build_idsz; i++){
+		h = (h << 5) + h + build_id[i];
+	}
+	while(*symbol){
+		h = (h << 5) + h + (unsigned char)*symbol++;
+	}
+	return h;
+}
+
+static inline size_t offsetsStart(size_t nentries){
+	return (sizeof(ElfPlanHeader) + sizeof(ElfPlanEntry) * nentries + 7) & ~(size_t)7;
+}
+
+/**
+ * 检查计划文件的每个偏移都在文件内, 之后的查询不需要再检查
+ */
+static bool loadPlanFile(HookPlan &p, const uint8_t *base, size_t size){
+	if(size < sizeof(ElfPlanHeader)){
+		return false;
+	}
+
+	const ElfPlanHeader *header = reinterpret_cast<const ElfPlanHeader *>(base);
+	if(header->magic != ELF_PLAN_MAGIC || header->version != ELF_PLAN_VERSION){
+		return false;
+	}
+
+	uint64_t start = offsetsStart(header->nentries);
+	uint64_t strings = start + sizeof(uint64_t) * (uint64_t)header->noffsets;
+	if(strings + header->strsz != size || !header->strsz || base[size - 1] != '\0'){
+		return false;
+	}
+
+	const ElfPlanEntry *entries = reinterpret_cast<const ElfPlanEntry *>(base + sizeof(ElfPlanHeader));
+	for(uint32_t i = 0; i < header->nentries; i++){
+		const ElfPlanEntry &entry = entries[i];
+
+		if((uint64_t)entry.first + entry.count > header->noffsets
+				|| (uint64_t)entry.build_id + entry.build_idsz > header->strsz
+				|| entry.symbol >= header->strsz || entry.soname >= header->strsz
+				|| (i && entries[i - 1].key > entry.key)){
+			return false;
+		}
+	}
+
+	p.base = base;
+	p.size = size;
+	p.entries = entries;
+	p.nentries = header->nentries;
+	p.offsets = reinterpret_cast<const uint64_t *>(base + start);
+	p.strings = reinterpret_cast<const char *>(base + strings);
+	return true;
+}
+
+static const ElfPlanEntry *findPlanEntry(const HookPlan &p, uint32_t key, const uint8_t *build_id, size_t build_idsz, const char *symbol){
+	size_t lo = 0, hi = p.nentries;
+
+	while(lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+		if(p.entries[mid].key < key){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+
+	for(; lo < p.nentries && p.entries[lo].key == key; lo++){
+		const ElfPlanEntry &entry = p.entries[lo];
+
+		if(entry.build_idsz == build_idsz && !memcmp(p.strings + entry.build_id, build_id, build_idsz)
+				&& !strcmp(p.strings + entry.symbol, symbol)){
+			return &entry;
+		}
+	}
+
+	return NULL;
+}
+
+static PlanRecord *findPlanRecord(const HookPlan &p, uint32_t key, const uint8_t *build_id, size_t build_idsz, const char *symbol){
+	for(PlanRecord *record = p.buckets[key % PLAN_BUCKETS]; record; record = record->next){
+		if(record->key == key && record->build_idsz == build_idsz
+				&& !memcmp(record->build_id, build_id, build_idsz) && !strcmp(record->symbol, symbol)){
+			return record;
+		}
+	}
+
+	return NULL;
+}
+
+bool findElfPlan(const uint8_t *build_id, size_t build_idsz, const char *symbol, const uint64_t **offsets, size_t *count, uint32_t *flags){
+	HookPlan *p = __atomic_load_n(&plan, __ATOMIC_ACQUIRE);
+	if(!p || !build_id || !build_idsz){
+		return false;
+	}
+
+	uint32_t key = planKey(build_id, build_idsz, symbol);
+
+	// the mapped file is immutable, no lock needed
+	const ElfPlanEntry *entry = findPlanEntry(*p, key, build_id, build_idsz, symbol);
+	if(entry){
+		*offsets = p->offsets + entry->first;
+		*count = entry->count;
+		*flags = entry->flags;
+		return true;
+	}
+
+	pthread_mutex_lock(&plan_lock);
+	PlanRecord *record = findPlanRecord(*p, key, build_id, build_idsz, symbol);
+	pthread_mutex_unlock(&plan_lock);
+
+	if(record){
+		*offsets = record->offsets;
+		*count = record->count;
+		*flags = record->flags;
+		return true;
+	}
+
+	return false;
+}
+
+void addElfPlan(const uint8_t *build_id, size_t build_idsz, const char *soname, const char *symbol, const uintptr_t *offsets, size_t count, uint32_t flags){
+	HookPlan *p = __atomic_load_n(&plan, __ATOMIC_ACQUIRE);
+	if(!p || !build_id || !build_idsz || build_idsz > ELF_BUILD_ID_MAX){
+		return;
+	}
+
+	uint32_t key = planKey(build_id, build_idsz, symbol);
+
+	pthread_mutex_lock(&plan_lock);
+
+	if(!findPlanRecord(*p, key, build_id, build_idsz, symbol)){
+		PlanRecord *record = (PlanRecord *) calloc(1, sizeof(PlanRecord));
+		record->key = key;
+		memcpy(record->build_id, build_id, build_idsz);
+		record->build_idsz = build_idsz;
+		record->soname = strdup(soname);
+		record->symbol = strdup(symbol);
+		record->offsets = (uint64_t *) malloc(sizeof(uint64_t) * (count + 1));
+		record->count = count;
+		record->flags = flags;
+
+		for(size_t i = 0; i < count; i++){
+			record->offsets[i] = offsets[i];
+		}
+
+		record->next = p->buckets[key % PLAN_BUCKETS];
+		p->buckets[key % PLAN_BUCKETS] = record;
+		p->nrecords++;
+	}
+
+	pthread_mutex_unlock(&plan_lock);
+}
+
+int elfHookLoadPlan(const char *path){
+	assert(path);
+
+	pthread_mutex_lock(&plan_lock);
+
+	if(plan){
+		pthread_mutex_unlock(&plan_lock);
+		LOGE("[-] hook plan has been loaded from %s.", plan->path);
+		return -1;
+	}
+
+	HookPlan *p = (HookPlan *) calloc(1, sizeof(HookPlan));
+	p->path = strdup(path);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd >= 0){
+		struct stat fs;
+		void *base = MAP_FAILED;
+
+		if(!fstat(fd, &fs) && fs.st_size > 0){
+			base = mmap(NULL, fs.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+
+		if(base != MAP_FAILED && loadPlanFile(*p, (const uint8_t *)base, fs.st_size)){
+			LOGI("[+] hook plan %s, %d entries.", path, (int)p->nentries);
+		}else{
+			LOGW("[-] hook plan %s is invalid, ignored.", path);
+			if(base != MAP_FAILED){
+				munmap(base, fs.st_size);
+			}
+		}
+	}else{
+		LOGI("[+] no hook plan at %s, a new one will be recorded.", path);
+	}
+
+	__atomic_store_n(&plan, p, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&plan_lock);
+	return 0;
+}
+
+/**
+ * 保存时使用的统一视图, 来自计划文件或者本次的记录
+ */
+struct PlanItem {
+	uint32_t key;
+	const uint8_t *build_id;
+	size_t build_idsz;
+	const char *soname;
+	const char *symbol;
+	const uint64_t *offsets;
+	size_t count;
+	uint32_t flags;
+};
+
+static int comparePlanItem(const void *a, const void *b){
+	const PlanItem *l = (const PlanItem *)a;
+	const PlanItem *r = (const PlanItem *)b;
+
+	if(l->key != r->key){
+		return l->key < r->key ? -1 : 1;
+	}
+	return 0;
+}
+
+static inline uint32_t nameKey(const char *soname, const char *symbol){
+	uint32_t h = 5381;
+	while(*soname){
+		h = (h << 5) + h + (unsigned char)*soname++;
+	}
+	return planKey((const uint8_t *)&h, sizeof(h), symbol);
+}
+
+/**
+ * 本次重新扫描过的(soname, symbol)说明build-id已经变化, 文件中的旧记录不再保留
+ */
+static bool isSuperseded(PlanRecord **index, uint32_t mask, const char *soname, const char *symbol){
+	for(uint32_t slot = nameKey(soname, symbol) & mask; index[slot]; slot = (slot + 1) & mask){
+		if(!strcmp(index[slot]->soname, soname) && !strcmp(index[slot]->symbol, symbol)){
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool writeAll(int fd, const void *data, size_t size){
+	const uint8_t *p = (const uint8_t *)data;
+	while(size){
+		ssize_t n = write(fd, p, size);
+		if(n <= 0){
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static int writePlanFile(const char *path, PlanItem *items, size_t nitems){
+	size_t noffsets = 0, strsz = 0;
+	for(size_t i = 0; i < nitems; i++){
+		noffsets += items[i].count;
+		strsz += items[i].build_idsz + strlen(items[i].soname) + strlen(items[i].symbol) + 2;
+	}
+
+	size_t start = offsetsStart(nitems);
+	size_t size = start + sizeof(uint64_t) * noffsets + strsz + 1;
+	uint8_t *buffer = (uint8_t *) calloc(1, size);
+
+	ElfPlanHeader *header = reinterpret_cast<ElfPlanHeader *>(buffer);
+	header->magic = ELF_PLAN_MAGIC;
+	header->version = ELF_PLAN_VERSION;
+	header->nentries = nitems;
+	header->noffsets = noffsets;
+	header->strsz = strsz + 1;
+
+	ElfPlanEntry *entries = reinterpret_cast<ElfPlanEntry *>(buffer + sizeof(ElfPlanHeader));
+	uint64_t *offsets = reinterpret_cast<uint64_t *>(buffer + start);
+	char *strings = reinterpret_cast<char *>(offsets + noffsets);
+	uint32_t first = 0, str = 0;
+
+	for(size_t i = 0; i < nitems; i++){
+		const PlanItem &item = items[i];
+		ElfPlanEntry &entry = entries[i];
+
+		entry.key = item.key;
+		entry.flags = item.flags;
+		entry.first = first;
+		entry.count = item.count;
+		memcpy(offsets + first, item.offsets, sizeof(uint64_t) * item.count);
+		first += item.count;
+
+		entry.build_id = str;
+		entry.build_idsz = item.build_idsz;
+		memcpy(strings + str, item.build_id, item.build_idsz);
+		str += item.build_idsz;
+
+		entry.soname = str;
+		strcpy(strings + str, item.soname);
+		str += strlen(item.soname) + 1;
+
+		entry.symbol = str;
+		strcpy(strings + str, item.symbol);
+		str += strlen(item.symbol) + 1;
+	}
+
+	// write a temporary file and rename it, readers never see a partial plan
+	size_t len = strlen(path);
+	char *tmp = (char *) malloc(len + 5);
+	memcpy(tmp, path, len);
+	strcpy(tmp + len, ".tmp");
+
+	int res = -1;
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if(fd >= 0){
+		bool ok = writeAll(fd, buffer, size);
+		close(fd);
+
+		if(ok && !rename(tmp, path)){
+			res = 0;
+		}else{
+			unlink(tmp);
+		}
+	}
+
+	if(res){
+		LOGE("[-] could not write hook plan %s.", path);
+	}
+
+	free(tmp);
+	free(buffer);
+	return res;
+}
+
+int elfHookSavePlan(){
+	pthread_mutex_lock(&plan_lock);
+
+	HookPlan *p = plan;
+	if(!p){
+		pthread_mutex_unlock(&plan_lock);
+		LOGE("[-] no hook plan has been loaded.");
+		return -1;
+	}
+
+	if(!p->nrecords){
+		pthread_mutex_unlock(&plan_lock);
+		return 0;
+	}
+
+	uint32_t size = 16;
+	while(size < p->nrecords * 2){
+		size <<= 1;
+	}
+
+	PlanRecord **index = (PlanRecord **) calloc(size, sizeof(PlanRecord *));
+	PlanItem *items = (PlanItem *) malloc(sizeof(PlanItem) * (p->nentries + p->nrecords));
+	size_t nitems = 0;
+
+	for(size_t i = 0; i < PLAN_BUCKETS; i++){
+		for(PlanRecord *record = p->buckets[i]; record; record = record->next){
+			uint32_t slot = nameKey(record->soname, record->symbol) & (size - 1);
+			while(index[slot]){
+				slot = (slot + 1) & (size - 1);
+			}
+			index[slot] = record;
+
+			PlanItem &item = items[nitems++];
+			item.key = record->key;
+			item.build_id = record->build_id;
+			item.build_idsz = record->build_idsz;
+			item.soname = record->soname;
+			item.symbol = record->symbol;
+			item.offsets = record->offsets;
+			item.count = record->count;
+			item.flags = record->flags;
+		}
+	}
+
+	for(size_t i = 0; i < p->nentries; i++){
+		const ElfPlanEntry &entry = p->entries[i];
+		const char *soname = p->strings + entry.soname;
+		const char *symbol = p->strings + entry.symbol;
+
+		if(isSuperseded(index, size - 1, soname, symbol)){
+			continue;
+		}
+
+		PlanItem &item = items[nitems++];
+		item.key = entry.key;
+		item.build_id = (const uint8_t *)p->strings + entry.build_id;
+		item.build_idsz = entry.build_idsz;
+		item.soname = soname;
+		item.symbol = symbol;
+		item.offsets = p->offsets + entry.first;
+		item.count = entry.count;
+		item.flags = entry.flags;
+	}
+
+	qsort(items, nitems, sizeof(PlanItem), comparePlanItem);
+	int res = writePlanFile(p->path, items, nitems);
+
+	LOGI("[+] hook plan %s saved, %d entries.", p->path, (int)nitems);
+
+	free(items);
+	free(index);
+	pthread_mutex_unlock(&plan_lock);
+	return res;
+}
@@ -0,0 +1,59 @@
+/*
+ * elfplan.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFPLAN_H_
+#define ELFPLAN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ELF_PLAN_MAGIC 0x4e4c5048 // "HPLN"
+#define ELF_PLAN_VERSION 1
+#define ELF_BUILD_ID_MAX 64
+
+// the module does not have the symbol at all
+#define ELF_PLAN_MISSING 1
+
+/**
+ * hook计划文件头, 文件布局为:
+ * ElfPlanHeader, 按key排序的ElfPlanEntry[nentries], 8字节对齐的uint64_t offsets[noffsets], 字符串区
+ */
+struct ElfPlanHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nentries;
+	uint32_t noffsets;
+	uint32_t strsz;
+	uint32_t reserved;
+};
+
+/**
+ * (build-id, 符号)到GOT偏移列表的映射, build_id, symbol和soname是字符串区中的偏移
+ * soname只用于保存时淘汰build-id已经变化的旧记录
+ */
+struct ElfPlanEntry {
+	uint32_t key;
+	uint32_t build_id;
+	uint32_t symbol;
+	uint32_t soname;
+	uint16_t build_idsz;
+	uint16_t flags;
+	uint32_t first;
+	uint32_t count;
+};
+
+/**
+ * 查询计划, 命中时offsets指向count个相对load bias的偏移, flags为ELF_PLAN_*
+ */
+bool findElfPlan(const uint8_t *build_id, size_t build_idsz, const char *symbol, const uint64_t **offsets, size_t *count, uint32_t *flags);
+
+/**
+ * 记录一次扫描的结果, 没有调用elfHookLoadPlan时什么也不做
+ */
+void addElfPlan(const uint8_t *build_id, size_t build_idsz, const char *soname, const char *symbol, const uintptr_t *offsets, size_t count, uint32_t flags);
+
+#endif /* ELFPLAN_H_ */
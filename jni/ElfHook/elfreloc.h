@@ -0,0 +1,233 @@
+/*
+ * elfreloc.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFRELOC_H_
+#define ELFRELOC_H_
+
+#include <elf.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef DT_ANDROID_REL
+#define DT_ANDROID_REL 0x6000000f
+#define DT_ANDROID_RELSZ 0x60000010
+#define DT_ANDROID_RELA 0x60000011
+#define DT_ANDROID_RELASZ 0x60000012
+#endif
+
+#ifndef DT_RELR
+#define DT_RELRSZ 35
+#define DT_RELR 36
+#define DT_RELRENT 37
+#endif
+
+#ifndef DT_ANDROID_RELR
+#define DT_ANDROID_RELR 0x6fffe000
+#define DT_ANDROID_RELRSZ 0x6fffe001
+#endif
+
+/**
+ * sleb128解码器
+ */
+class Sleb128Decoder {
+public:
+	Sleb128Decoder(const uint8_t *buffer, size_t size) : current(buffer), end(buffer + size) {}
+
+	bool empty() const {
+		return current >= end;
+	}
+
+	int64_t pop() {
+		int64_t value = 0;
+		unsigned shift = 0;
+		uint8_t byte;
+
+		do {
+			if(current >= end){
+				return 0;
+			}
+			byte = *current++;
+			value |= (int64_t)(byte & 0x7f) << shift;
+			shift += 7;
+		} while(byte & 0x80);
+
+		if(shift < 64 && (byte & 0x40)){
+			value |= -((int64_t)1 << shift);
+		}
+
+		return value;
+	}
+
+private:
+	const uint8_t *current;
+	const uint8_t *end;
+};
+
+static inline void setRelAddend(Elf32_Rel &, int64_t) {}
+static inline void setRelAddend(Elf64_Rel &, int64_t) {}
+static inline void setRelAddend(Elf32_Rela &rel, int64_t addend) { rel.r_addend = addend; }
+static inline void setRelAddend(Elf64_Rela &rel, int64_t addend) { rel.r_addend = addend; }
+
+/**
+ * Android APS2格式(DT_ANDROID_REL/DT_ANDROID_RELA)的流式解码, 每次只解出一条重定位
+ */
+template<class T>
+class PackedRelIterator {
+public:
+	enum {
+		GROUPED_BY_INFO = 1,
+		GROUPED_BY_OFFSET_DELTA = 2,
+		GROUPED_BY_ADDEND = 4,
+		GROUP_HAS_ADDEND = 8
+	};
+
+	PackedRelIterator(const uint8_t *packed, size_t size)
+		: decoder(packed + 4, size > 4 ? size - 4 : 0), count(0), index(0),
+		  group_size(0), group_index(0), group_flags(0), group_offset_delta(0),
+		  offset(0), info(0), addend(0) {
+		if(size > 4 && packed[0] == 'A' && packed[1] == 'P' && packed[2] == 'S' && packed[3] == '2'){
+			count = decoder.pop();
+			offset = decoder.pop();
+		}
+	}
+
+	/**
+	 * 重定位总数, 来自APS2头
+	 */
+	size_t size() const {
+		return count;
+	}
+
+	bool next(typename T::Rel &rel) {
+		if(index >= count){
+			return false;
+		}
+
+		if(group_index == group_size){
+			readGroup();
+		}
+
+		if(group_flags & GROUPED_BY_OFFSET_DELTA){
+			offset += group_offset_delta;
+		}else{
+			offset += decoder.pop();
+		}
+
+		if(!(group_flags & GROUPED_BY_INFO)){
+			info = decoder.pop();
+		}
+
+		if((group_flags & GROUP_HAS_ADDEND) && !(group_flags & GROUPED_BY_ADDEND)){
+			addend += decoder.pop();
+		}
+
+		index++;
+		group_index++;
+
+		rel.r_offset = offset;
+		rel.r_info = info;
+		setRelAddend(rel, addend);
+		return true;
+	}
+
+private:
+	void readGroup() {
+		group_size = decoder.pop();
+		group_flags = decoder.pop();
+		group_index = 0;
+
+		if(group_flags & GROUPED_BY_OFFSET_DELTA){
+			group_offset_delta = decoder.pop();
+		}
+
+		if(group_flags & GROUPED_BY_INFO){
+			info = decoder.pop();
+		}
+
+		if((group_flags & GROUP_HAS_ADDEND) && (group_flags & GROUPED_BY_ADDEND)){
+			addend += decoder.pop();
+		}else if(!(group_flags & GROUP_HAS_ADDEND)){
+			addend = 0;
+		}
+	}
+
+	Sleb128Decoder decoder;
+
+	size_t count;
+	size_t index;
+
+	size_t group_size;
+	size_t group_index;
+	int64_t group_flags;
+	int64_t group_offset_delta;
+
+	typename T::Addr offset;
+	uint64_t info;
+	int64_t addend;
+};
+
+/**
+ * DT_RELR的流式解码, 只有R_*_RELATIVE, 每次返回一个需要重定位的偏移
+ */
+template<class T>
+class RelrIterator {
+public:
+	typedef typename T::Addr Addr;
+
+	RelrIterator(const Addr *relr, size_t count)
+		: current(relr), end(relr + count), base(0), bitmap(0), bit(0) {}
+
+	bool next(Addr &offset) {
+		const unsigned bits = sizeof(Addr) * 8 - 1;
+
+		for(;;){
+			// drain the pending bitmap first
+			while(bitmap){
+				bit++;
+				bool set = bitmap & 1;
+				bitmap >>= 1;
+
+				if(set){
+					offset = base + (bit - 1) * sizeof(Addr);
+					return true;
+				}
+			}
+
+			if(bit){
+				base += bits * sizeof(Addr);
+				bit = 0;
+			}
+
+			if(current >= end){
+				return false;
+			}
+
+			Addr entry = *current++;
+			if(!(entry & 1)){
+				offset = entry;
+				base = entry + sizeof(Addr);
+				return true;
+			}
+
+			bitmap = entry >> 1;
+			bit = 0;
+			if(!bitmap){
+				base += bits * sizeof(Addr);
+			}
+		}
+	}
+
+private:
+	const Addr *current;
+	const Addr *end;
+
+	Addr base;
+	Addr bitmap;
+	unsigned bit;
+};
+
+#endif /* ELFRELOC_H_ */
@@ -0,0 +1,150 @@
+/*
+ * elfscan.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdint.h>
+#include <elf.h>
+
+#include "common.h"
+#include "elfscan.h"
+
+#if defined(__aarch64__) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCAN_SIMD 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_SIMD 1
+#else
+#define SCAN_SIMD 0
+#endif
+
+// words compared per iteration, four 128-bit vectors
+#define SCAN_BLOCK (64 / sizeof(uintptr_t))
+
+#if SCAN_SIMD
+
+#if defined(__aarch64__)
+
+typedef uint64x2_t ScanVec;
+
+static inline ScanVec splatWord(uintptr_t value){
+	return vdupq_n_u64(value);
+}
+
+static inline bool matchBlock(const uintptr_t *p, ScanVec v){
+	const uint64_t *q = (const uint64_t *)p;
+	uint64x2_t m = vorrq_u64(vorrq_u64(vceqq_u64(vld1q_u64(q), v), vceqq_u64(vld1q_u64(q + 2), v)),
+			vorrq_u64(vceqq_u64(vld1q_u64(q + 4), v), vceqq_u64(vld1q_u64(q + 6), v)));
+	return vmaxvq_u32(vreinterpretq_u32_u64(m)) != 0;
+}
+
+#elif defined(__ARM_NEON__)
+
+typedef uint32x4_t ScanVec;
+
+static inline ScanVec splatWord(uintptr_t value){
+	return vdupq_n_u32(value);
+}
+
+static inline bool matchBlock(const uintptr_t *p, ScanVec v){
+	const uint32_t *q = (const uint32_t *)p;
+	uint32x4_t m = vorrq_u32(vorrq_u32(vceqq_u32(vld1q_u32(q), v), vceqq_u32(vld1q_u32(q + 4), v)),
+			vorrq_u32(vceqq_u32(vld1q_u32(q + 8), v), vceqq_u32(vld1q_u32(q + 12), v)));
+	uint32x2_t d = vorr_u32(vget_low_u32(m), vget_high_u32(m));
+	return vget_lane_u64(vreinterpret_u64_u32(d), 0) != 0;
+}
+
+#else
+
+typedef __m128i ScanVec;
+
+static inline ScanVec splatWord(uintptr_t value){
+#if defined(__x86_64__)
+	return _mm_set1_epi64x(value);
+#else
+	return _mm_set1_epi32(value);
+#endif
+}
+
+static inline __m128i matchVec(const uintptr_t *p, ScanVec v){
+	__m128i m = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)p), v);
+#if defined(__x86_64__)
+	// SSE2 has no 64-bit compare, both halves must match
+	m = _mm_and_si128(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+#endif
+	return m;
+}
+
+static inline bool matchBlock(const uintptr_t *p, ScanVec v){
+	const size_t step = 16 / sizeof(uintptr_t);
+	__m128i m = _mm_or_si128(_mm_or_si128(matchVec(p, v), matchVec(p + step, v)),
+			_mm_or_si128(matchVec(p + step * 2, v), matchVec(p + step * 3, v)));
+	return _mm_movemask_epi8(m) != 0;
+}
+
+#endif
+
+#endif
+
+/**
+ * 返回[p, end)中第一个等于value的字, 没有时返回end
+ */
+static const uintptr_t *findWord(const uintptr_t *p, const uintptr_t *end, uintptr_t value){
+#if SCAN_SIMD
+	for(; p < end && ((uintptr_t)p & 15); p++){
+		if(*p == value){
+			return p;
+		}
+	}
+
+	// skip the blocks without a match, the scalar loop locates it in the block
+	ScanVec v = splatWord(value);
+	for(; (size_t)(end - p) >= SCAN_BLOCK; p += SCAN_BLOCK){
+		if(matchBlock(p, v)){
+			break;
+		}
+	}
+#endif
+
+	for(; p < end; p++){
+		if(*p == value){
+			return p;
+		}
+	}
+
+	return end;
+}
+
+size_t collectElfModuleWords(const ElfModule *module, void *target, void *value, void **old_func, void **skip, ElfPatchBuffer *buffer){
+	const ElfInfo &info = module->info;
+	const uintptr_t align = sizeof(void *) - 1;
+	size_t count = 0;
+
+	for(int i = 0; i < info.phnum; i++){
+		const ElfNative::Phdr &phdr = info.phdr[i];
+		if(phdr.p_type != PT_LOAD || !(phdr.p_flags & PF_W)){
+			continue;
+		}
+
+		uintptr_t start = ((uintptr_t)info.elf_base + phdr.p_vaddr + align) & ~align;
+		uintptr_t stop = ((uintptr_t)info.elf_base + phdr.p_vaddr + phdr.p_memsz) & ~align;
+
+		const uintptr_t *end = (const uintptr_t *)stop;
+		const uintptr_t *p = findWord((const uintptr_t *)start, end, (uintptr_t)target);
+		for(; p < end; p = findWord(p + 1, end, (uintptr_t)target)){
+			void **addr = (void **)p;
+			if(addr == skip){
+				continue;
+			}
+
+			addPatch(buffer, addr, value, old_func);
+			count++;
+		}
+	}
+
+	LOGI("[+] %d words of %p in %s.", (int)count, target, module->soname);
+	return count;
+}
@@ -0,0 +1,22 @@
+/*
+ * elfscan.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFSCAN_H_
+#define ELFSCAN_H_
+
+#include <stddef.h>
+
+#include "elfmodule.h"
+#include "elfpatch.h"
+
+/**
+ * 在模块所有可写的PT_LOAD中查找等于target的对齐指针, 包括.got, .data.rel.ro, .data和.bss
+ * 每个命中的地址加入buffer, 写入value, skip为不需要修改的地址, 例如保存原函数的变量. 返回命中个数
+ */
+size_t collectElfModuleWords(const ElfModule *module, void *target, void *value, void **old_func, void **skip, ElfPatchBuffer *buffer);
+
+#endif /* ELFSCAN_H_ */
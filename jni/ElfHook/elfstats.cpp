@@ -0,0 +1,427 @@
+/*
+ * elfstats.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "elfhook.h"
+#include "elfstats.h"
+#include "elftrace.h"
+#include "elfthunk.h"
+#include "elfguard.h"
+
+#define MAX_INSTRUMENTED 256
+
+#define CACHE_LINE 64
+
+// argument registers passed to elfStatsTrace
+#if defined(__arm__)
+#define REG_ARGS 4
+#else
+#define REG_ARGS 6
+#endif
+
+#define SUB_BUCKETS (1 << HOOK_STATS_SUB_BITS)
+#define MAX_LATENCY_BITS 36
+
+/**
+ * 一个线程对一个hook的统计, 只有所属线程写入, 按cache line对齐避免伪共享
+ * 线程退出后分片保留计数, 由之后的新线程接管继续累加
+ * 延迟的单位是readTicks的计数, 快照时才换算成ns
+ */
+struct HookShard {
+	HookShard *next;
+
+	// 0 once the owning thread has exited
+	int owner;
+
+	uint64_t calls;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HOOK_STATS_BUCKETS];
+} __attribute__((aligned(CACHE_LINE)));
+
+/**
+ * 一个插桩hook, thunk把它传给elf_stats_call, 前两项由elf_stats_call读取, 顺序不能改变
+ */
+struct HookStatsEntry {
+	void *old_func;
+
+	// arguments recorded by elfTraceEvent, 0 when not traced
+	int trace_nargs;
+
+	HookShard *shards;
+
+	char *soname;
+	char *symbol;
+	uint8_t *thunk;
+	int id;
+};
+
+/**
+ * 每个线程的分片, 用mmap分配, 插桩malloc时也不会重入
+ */
+struct ThreadStats {
+	bool busy;
+	HookShard *shards[MAX_INSTRUMENTED];
+};
+
+static HookStatsEntry *entries[MAX_INSTRUMENTED];
+static int nentries = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the key only frees the shards when the thread exits, lookups go through thread_stats
+static pthread_key_t stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+// same TLS model as elf_guard_bits
+#if ELF_GUARD_TLS
+static __thread ThreadStats *thread_stats __attribute__((tls_model("initial-exec")));
+#else
+static __thread ThreadStats *thread_stats;
+#endif
+
+// readTicks and nowNs when the statistics started, the scale of the counter is derived from them
+static uint64_t anchor_ticks;
+static uint64_t anchor_ns;
+
+extern "C" {
+
+// elfstats_entry.S
+void elf_stats_call();
+
+void elfStatsTrace(HookStatsEntry *entry, const void *ret_addr, const uintptr_t *args) __attribute__((visibility("hidden")));
+void elfStatsRecord(HookStatsEntry *entry, uint64_t ticks) __attribute__((visibility("hidden")));
+uint64_t elfStatsTicks() __attribute__((visibility("hidden")));
+
+}
+
+static inline uint64_t nowNs(){
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * elf_stats_call计时用的计数器, x86-64为TSC, arm64为CNTVCT_EL0
+ * arm没有一定能在用户态读取的计数器, 使用nowNs
+ */
+static inline uint64_t readTicks(){
+#if defined(__x86_64__)
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return (uint64_t)hi << 32 | lo;
+#elif defined(__aarch64__)
+	uint64_t ticks;
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return nowNs();
+#endif
+}
+
+uint64_t elfStatsTicks(){
+	return readTicks();
+}
+
+/**
+ * 每个计数的ns数, x86-64由开始统计以来的计数和时间得出, 不足10ms时先等待
+ */
+static double getNsPerTick(){
+#if defined(__x86_64__)
+	uint64_t elapsed = nowNs() - anchor_ns;
+	if(elapsed < 10000000){
+		usleep((10000000 - elapsed) / 1000 + 1);
+	}
+
+	uint64_t ticks = readTicks();
+	elapsed = nowNs() - anchor_ns;
+	return ticks > anchor_ticks ? (double)elapsed / (ticks - anchor_ticks) : 1.0;
+#elif defined(__aarch64__)
+	uint64_t freq;
+	__asm__("mrs %0, cntfrq_el0" : "=r"(freq));
+	return freq ? 1e9 / freq : 1.0;
+#else
+	return 1.0;
+#endif
+}
+
+int getHookStatsBucket(uint64_t ns){
+	if(ns >> MAX_LATENCY_BITS){
+		ns = (1ULL << MAX_LATENCY_BITS) - 1;
+	}
+
+	if(ns < 2 * SUB_BUCKETS){
+		return ns;
+	}
+
+	int shift = 63 - __builtin_clzll(ns) - HOOK_STATS_SUB_BITS;
+	return (shift + 1) * SUB_BUCKETS + (int)(ns >> shift) - SUB_BUCKETS;
+}
+
+uint64_t getHookStatsBucketMax(int bucket){
+	if(bucket < 2 * SUB_BUCKETS){
+		return bucket;
+	}
+
+	int shift = bucket / SUB_BUCKETS - 1;
+	uint64_t base = (uint64_t)(bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+	return base + (1ULL << shift) - 1;
+}
+
+uint64_t getHookStatsPercentile(const HookStats *stats, double q){
+	assert(stats);
+
+	if(!stats->calls){
+		return 0;
+	}
+
+	uint64_t rank = (uint64_t)(q * stats->calls);
+	uint64_t seen = 0;
+	for(int i = 0; i < HOOK_STATS_BUCKETS; i++){
+		seen += stats->buckets[i];
+		if(seen > rank){
+			return getHookStatsBucketMax(i);
+		}
+	}
+
+	return stats->max_ns;
+}
+
+static void freeThreadStats(void *data){
+	ThreadStats *stats = (ThreadStats *)data;
+
+	for(int i = 0; i < MAX_INSTRUMENTED; i++){
+		if(stats->shards[i]){
+			__atomic_store_n(&stats->shards[i]->owner, 0, __ATOMIC_RELEASE);
+		}
+	}
+
+	munmap(data, sizeof(ThreadStats));
+}
+
+static void initStats(){
+	pthread_key_create(&stats_key, freeThreadStats);
+
+	anchor_ns = nowNs();
+	anchor_ticks = readTicks();
+}
+
+static ThreadStats *getThreadStats(){
+	ThreadStats *stats = thread_stats;
+	if(stats){
+		return stats;
+	}
+
+	void *data = mmap(NULL, sizeof(ThreadStats), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(data == MAP_FAILED){
+		return NULL;
+	}
+
+	pthread_setspecific(stats_key, data);
+	thread_stats = (ThreadStats *)data;
+	return thread_stats;
+}
+
+static HookShard *allocShard(HookStatsEntry *entry){
+	// a shard left by an exited thread, the hook keeps as many shards as threads ever ran at once
+	for(HookShard *it = __atomic_load_n(&entry->shards, __ATOMIC_ACQUIRE); it; it = it->next){
+		int expected = 0;
+		if(__atomic_compare_exchange_n(&it->owner, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+			return it;
+		}
+	}
+
+	void *data = NULL;
+	if(posix_memalign(&data, CACHE_LINE, sizeof(HookShard))){
+		return NULL;
+	}
+
+	HookShard *shard = (HookShard *)data;
+	memset(shard, 0, sizeof(HookShard));
+	shard->min = UINT64_MAX;
+	shard->owner = 1;
+
+	// snapshots walk the list without the lock
+	shard->next = __atomic_load_n(&entry->shards, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&entry->shards, &shard->next, shard, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+	}
+
+	return shard;
+}
+
+// single writer per shard, relaxed stores keep snapshots free of torn values
+#define SHARD_ADD(field, value) \
+	__atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+
+void elfStatsTrace(HookStatsEntry *entry, const void *ret_addr, const uintptr_t *args){
+	// calls made by the bookkeeping itself are not traced
+	ThreadStats *stats = getThreadStats();
+	if(!stats || stats->busy){
+		return;
+	}
+
+	int nargs = __atomic_load_n(&entry->trace_nargs, __ATOMIC_RELAXED);
+	if(nargs){
+		stats->busy = true;
+		elfTraceEvent(entry->id, ret_addr, args, nargs);
+		stats->busy = false;
+	}
+}
+
+void elfStatsRecord(HookStatsEntry *entry, uint64_t ticks){
+	ThreadStats *stats = getThreadStats();
+	if(!stats || stats->busy){
+		return;
+	}
+
+	HookShard *shard = stats->shards[entry->id];
+	if(!shard){
+		// malloc called by allocShard may be instrumented too
+		stats->busy = true;
+		shard = allocShard(entry);
+		stats->busy = false;
+
+		if(!shard){
+			return;
+		}
+		stats->shards[entry->id] = shard;
+	}
+
+	SHARD_ADD(shard->calls, 1);
+	SHARD_ADD(shard->total, ticks);
+	SHARD_ADD(shard->buckets[getHookStatsBucket(ticks)], 1);
+
+	if(ticks < shard->min){
+		__atomic_store_n(&shard->min, ticks, __ATOMIC_RELAXED);
+	}
+	if(ticks > shard->max){
+		__atomic_store_n(&shard->max, ticks, __ATOMIC_RELAXED);
+	}
+}
+
+static void freeStatsEntry(HookStatsEntry *entry){
+	free(entry->soname);
+	free(entry->symbol);
+	free(entry);
+}
+
+int elfHookInstrument(const char *soname, const char *symbol, const char *version){
+	assert(symbol);
+
+	pthread_once(&stats_once, initStats);
+	pthread_mutex_lock(&stats_lock);
+
+	if(nentries >= MAX_INSTRUMENTED){
+		pthread_mutex_unlock(&stats_lock);
+		LOGE("[-] too many instrumented hooks.");
+		return -1;
+	}
+
+	HookStatsEntry *entry = (HookStatsEntry *) calloc(1, sizeof(HookStatsEntry));
+	entry->soname = strdup(soname ? soname : "");
+	entry->symbol = strdup(symbol);
+	entry->id = nentries;
+
+	entry->thunk = (uint8_t *) createWrapperThunk(entry, elf_stats_call);
+	if(!entry->thunk){
+		pthread_mutex_unlock(&stats_lock);
+		freeStatsEntry(entry);
+		LOGE("[-] could not create the wrapper of %s.", symbol);
+		return -1;
+	}
+
+	if(elfHook(soname, symbol, entry->thunk, &entry->old_func, version)){
+		releaseWrapperThunk(entry->thunk);
+		pthread_mutex_unlock(&stats_lock);
+		freeStatsEntry(entry);
+		return -1;
+	}
+
+	__atomic_store_n(&entries[entry->id], entry, __ATOMIC_RELEASE);
+	__atomic_store_n(&nentries, entry->id + 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&stats_lock);
+
+	LOGI("[+] %s in %s is instrumented, id %d.", symbol, entry->soname, entry->id);
+	return entry->id;
+}
+
+int elfHookSnapshot(int id, HookStats *stats){
+	assert(stats);
+
+	if(id < 0 || id >= __atomic_load_n(&nentries, __ATOMIC_ACQUIRE)){
+		LOGE("[-] %d is not an instrumented hook.", id);
+		return -1;
+	}
+
+	HookStatsEntry *entry = __atomic_load_n(&entries[id], __ATOMIC_ACQUIRE);
+
+	memset(stats, 0, sizeof(HookStats));
+	stats->soname = entry->soname;
+	stats->symbol = entry->symbol;
+
+	uint64_t total = 0, min = UINT64_MAX, max = 0;
+	uint64_t buckets[HOOK_STATS_BUCKETS] = {0};
+
+	for(HookShard *shard = __atomic_load_n(&entry->shards, __ATOMIC_ACQUIRE); shard; shard = shard->next){
+		stats->calls += __atomic_load_n(&shard->calls, __ATOMIC_RELAXED);
+		total += __atomic_load_n(&shard->total, __ATOMIC_RELAXED);
+
+		uint64_t shard_min = __atomic_load_n(&shard->min, __ATOMIC_RELAXED);
+		uint64_t shard_max = __atomic_load_n(&shard->max, __ATOMIC_RELAXED);
+		min = shard_min < min ? shard_min : min;
+		max = shard_max > max ? shard_max : max;
+
+		for(int i = 0; i < HOOK_STATS_BUCKETS; i++){
+			buckets[i] += __atomic_load_n(&shard->buckets[i], __ATOMIC_RELAXED);
+		}
+	}
+
+	if(!stats->calls){
+		return 0;
+	}
+
+	// a bucket of ticks moves to the bucket of its upper bound in ns
+	double scale = getNsPerTick();
+	stats->total_ns = (uint64_t)(total * scale);
+	stats->min_ns = (uint64_t)(min * scale);
+	stats->max_ns = (uint64_t)(max * scale);
+
+	for(int i = 0; i < HOOK_STATS_BUCKETS; i++){
+		if(buckets[i]){
+			stats->buckets[getHookStatsBucket((uint64_t)(getHookStatsBucketMax(i) * scale))] += buckets[i];
+		}
+	}
+
+	return 0;
+}
+
+int elfHookTrace(int id, int nargs){
+	if(id < 0 || id >= __atomic_load_n(&nentries, __ATOMIC_ACQUIRE)){
+		LOGE("[-] %d is not an instrumented hook.", id);
+		return -1;
+	}
+
+	if(nargs > TRACE_MAX_ARGS){
+		nargs = TRACE_MAX_ARGS;
+	}
+	if(nargs > REG_ARGS){
+		nargs = REG_ARGS;
+	}
+
+	HookStatsEntry *entry = __atomic_load_n(&entries[id], __ATOMIC_ACQUIRE);
+	__atomic_store_n(&entry->trace_nargs, nargs < 0 ? 0 : nargs, __ATOMIC_RELAXED);
+	return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * elfstats.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFSTATS_H_
+#define ELFSTATS_H_
+
+#include <stdint.h>
+
+// 16 sub-buckets per power of two, about 6% relative error
+#define HOOK_STATS_SUB_BITS 4
+
+// latencies above 2^36 ns (about 68s) share the last bucket
+#define HOOK_STATS_BUCKETS 528
+
+/**
+ * 插桩hook的统计快照, 由各线程的分片合并而来, 时间单位为ns
+ * 直方图为HDR风格的对数-线性分桶
+ */
+struct HookStats {
+	const char *soname;
+	const char *symbol;
+
+	uint64_t calls;
+	uint64_t total_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t buckets[HOOK_STATS_BUCKETS];
+};
+
+/**
+ * 延迟所在的桶
+ */
+int getHookStatsBucket(uint64_t ns);
+
+/**
+ * 桶能表示的最大延迟
+ */
+uint64_t getHookStatsBucketMax(int bucket);
+
+/**
+ * q分位的延迟, q在0到1之间, 返回所在桶的上界
+ */
+uint64_t getHookStatsPercentile(const HookStats *stats, double q);
+
+#endif /* ELFSTATS_H_ */
@@ -0,0 +1,313 @@
+/*
+ * elfsymbolize.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "elfsymbolize.h"
+#include "elfmodule.h"
+#include "elfio.h"
+
+/**
+ * 一个函数符号, 和SymModule::starts中同一下标的起始地址对应
+ */
+struct SymEntry {
+	const char *name;
+	size_t size;
+};
+
+/**
+ * 一个模块的地址索引, 二分查找只访问有序的starts
+ */
+struct SymModule {
+	SymModule *next;
+
+	char *soname;
+	uintptr_t bias;
+	const void *phdr;
+	uintptr_t start;
+	uintptr_t end;
+
+	uintptr_t *starts;
+	SymEntry *syms;
+	size_t nsyms;
+
+	// keeps the .symtab names mapped
+	ElfHandle *file;
+};
+
+/**
+ * 按start排序的模块区间表, 发布之后不再修改
+ */
+struct SymTable {
+	SymTable *prev;
+	size_t n;
+	uintptr_t *starts;
+	SymModule **modules;
+};
+
+/**
+ * 建立索引时的临时数组
+ */
+struct SymBuilder {
+	struct Item {
+		uintptr_t start;
+		size_t size;
+		const char *name;
+	} *items;
+
+	size_t n;
+	size_t capacity;
+};
+
+static pthread_mutex_t refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// only touched under refresh_lock, indexes are never freed
+static SymModule *sym_modules = NULL;
+
+// old tables stay alive, a lookup may still be reading them
+static SymTable *sym_table = NULL;
+
+static void addFuncSyms(SymBuilder &builder, const ElfSym *syms, size_t nsyms, const char *strtab, size_t strsz, uintptr_t bias){
+	for(size_t i = 0; i < nsyms; i++){
+		const ElfSym &sym = syms[i];
+
+		// ELF32_ST_TYPE and ELF64_ST_TYPE are the same
+		if(ELF32_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_shndx == SHN_UNDEF || !sym.st_value || sym.st_name >= strsz){
+			continue;
+		}
+
+		if(builder.n == builder.capacity){
+			builder.capacity = builder.capacity ? builder.capacity * 2 : 256;
+			builder.items = (SymBuilder::Item *) realloc(builder.items, sizeof(SymBuilder::Item) * builder.capacity);
+		}
+
+		SymBuilder::Item &item = builder.items[builder.n++];
+		item.start = bias + sym.st_value;
+#if defined(__arm__)
+		// the thumb bit is not part of the address
+		item.start &= ~(uintptr_t)1;
+#endif
+		item.size = sym.st_size;
+		item.name = strtab + sym.st_name;
+	}
+}
+
+/**
+ * 从文件中读取.symtab, 没有时返回NULL, 否则返回的handle保持名字的映射
+ */
+static ElfHandle *addFileSyms(SymBuilder &builder, const char *path, uintptr_t bias){
+	// libraries loaded directly from an apk have no file of their own
+	if(strchr(path, '!')){
+		return NULL;
+	}
+
+	ElfHandle *handle = openElfByFileLazy(path);
+	if(!handle){
+		return NULL;
+	}
+
+	size_t before = builder.n;
+	const ElfNative::Ehdr *ehdr = (const ElfNative::Ehdr *) readElfFile(handle, 0, sizeof(ElfNative::Ehdr));
+	const ElfNative::Shdr *shdr = NULL;
+
+	if(ehdr && !memcmp(ehdr->e_ident, ELFMAG, SELFMAG) && ehdr->e_ident[EI_CLASS] == ElfNative::ELFCLASS
+			&& ehdr->e_shentsize == sizeof(ElfNative::Shdr) && ehdr->e_shnum){
+		shdr = (const ElfNative::Shdr *) readElfFile(handle, ehdr->e_shoff, sizeof(ElfNative::Shdr) * ehdr->e_shnum);
+	}
+
+	for(int i = 0; shdr && i < ehdr->e_shnum; i++){
+		if(shdr[i].sh_type != SHT_SYMTAB || shdr[i].sh_link >= ehdr->e_shnum){
+			continue;
+		}
+
+		const ElfNative::Shdr &strs = shdr[shdr[i].sh_link];
+		const ElfSym *syms = (const ElfSym *) mapElfFile(handle, shdr[i].sh_offset, shdr[i].sh_size, MADV_SEQUENTIAL);
+		const char *strtab = (const char *) mapElfFile(handle, strs.sh_offset, strs.sh_size, MADV_RANDOM);
+
+		if(syms && strtab){
+			addFuncSyms(builder, syms, shdr[i].sh_size / sizeof(ElfSym), strtab, strs.sh_size, bias);
+		}
+	}
+
+	if(builder.n == before){
+		closeElfByFile(handle);
+		return NULL;
+	}
+
+	return handle;
+}
+
+static int compareItem(const void *a, const void *b){
+	const SymBuilder::Item *l = (const SymBuilder::Item *)a;
+	const SymBuilder::Item *r = (const SymBuilder::Item *)b;
+
+	if(l->start != r->start){
+		return l->start < r->start ? -1 : 1;
+	}
+
+	// aliases share an address, keep the one with a size
+	return (l->size == 0) - (r->size == 0);
+}
+
+static SymModule *buildSymModule(const ElfLibInfo *lib){
+	SymModule *module = (SymModule *) calloc(1, sizeof(SymModule));
+	module->soname = strdup(lib->name);
+	module->bias = lib->bias;
+	module->phdr = lib->phdr;
+
+	const ElfNative::Phdr *phdr = (const ElfNative::Phdr *) lib->phdr;
+	module->start = UINTPTR_MAX;
+	for(size_t i = 0; i < lib->phnum; i++){
+		if(phdr[i].p_type == PT_LOAD){
+			uintptr_t start = lib->bias + phdr[i].p_vaddr;
+			uintptr_t end = start + phdr[i].p_memsz;
+			module->start = start < module->start ? start : module->start;
+			module->end = end > module->end ? end : module->end;
+		}
+	}
+
+	SymBuilder builder = {NULL, 0, 0};
+
+	ElfModule *elf = getElfModuleByLib(lib);
+	if(elf->info.sym && elf->info.symstr){
+		addFuncSyms(builder, elf->info.sym, elf->info.symsz, elf->info.symstr, (size_t)-1, lib->bias);
+	}
+
+	module->file = addFileSyms(builder, *lib->name ? lib->name : "/proc/self/exe", lib->bias);
+
+	qsort(builder.items, builder.n, sizeof(SymBuilder::Item), compareItem);
+
+	module->starts = (uintptr_t *) malloc(sizeof(uintptr_t) * (builder.n + 1));
+	module->syms = (SymEntry *) malloc(sizeof(SymEntry) * (builder.n + 1));
+
+	// .symtab repeats the exported functions of .dynsym
+	for(size_t i = 0; i < builder.n; i++){
+		const SymBuilder::Item &item = builder.items[i];
+		if(module->nsyms && module->starts[module->nsyms - 1] == item.start){
+			continue;
+		}
+
+		module->starts[module->nsyms] = item.start;
+		module->syms[module->nsyms].name = item.name;
+		module->syms[module->nsyms].size = item.size;
+		module->nsyms++;
+	}
+
+	free(builder.items);
+
+	LOGI("[+] module %s, %d functions indexed.", module->soname, (int)module->nsyms);
+	return module;
+}
+
+static SymModule *getSymModule(const ElfLibInfo *lib){
+	for(SymModule *module = sym_modules; module; module = module->next){
+		if(module->bias == lib->bias && module->phdr == lib->phdr && !strcmp(module->soname, lib->name)){
+			return module;
+		}
+	}
+
+	SymModule *module = buildSymModule(lib);
+	module->next = sym_modules;
+	sym_modules = module;
+	return module;
+}
+
+static int compareModule(const void *a, const void *b){
+	uintptr_t l = (*(const SymModule **)a)->start;
+	uintptr_t r = (*(const SymModule **)b)->start;
+	return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+int elfSymbolizeRefresh(){
+	pthread_mutex_lock(&refresh_lock);
+
+	const ElfLibTable *libtable = acquireLibTable();
+	const ElfLibInfo *libs = NULL;
+	size_t nlibs = getLibInfos(libtable, &libs);
+
+	SymTable *table = (SymTable *) malloc(sizeof(SymTable));
+	table->starts = (uintptr_t *) malloc(sizeof(uintptr_t) * (nlibs + 1));
+	table->modules = (SymModule **) malloc(sizeof(SymModule *) * (nlibs + 1));
+	table->n = 0;
+
+	for(size_t i = 0; i < nlibs; i++){
+		SymModule *module = getSymModule(libs + i);
+		if(module->end > module->start){
+			table->modules[table->n++] = module;
+		}
+	}
+
+	releaseLibTable(libtable);
+
+	qsort(table->modules, table->n, sizeof(SymModule *), compareModule);
+	for(size_t i = 0; i < table->n; i++){
+		table->starts[i] = table->modules[i]->start;
+	}
+
+	table->prev = sym_table;
+	__atomic_store_n(&sym_table, table, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&refresh_lock);
+
+	LOGI("[+] symbolize index refreshed, %d modules.", (int)table->n);
+	return table->n;
+}
+
+/**
+ * 最后一个不大于addr的下标, 没有时返回n
+ */
+static inline size_t findFloor(const uintptr_t *starts, size_t n, uintptr_t addr){
+	size_t lo = 0, hi = n;
+
+	while(lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+		if(starts[mid] <= addr){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+
+	return lo ? lo - 1 : n;
+}
+
+bool elfSymbolize(const void *addr, ElfSymbolInfo *info){
+	const SymTable *table = __atomic_load_n(&sym_table, __ATOMIC_ACQUIRE);
+	if(!table){
+		return false;
+	}
+
+	uintptr_t value = (uintptr_t)addr;
+	size_t i = findFloor(table->starts, table->n, value);
+	if(i == table->n || value >= table->modules[i]->end){
+		return false;
+	}
+
+	const SymModule *module = table->modules[i];
+	info->soname = module->soname;
+	info->base = (void *)module->bias;
+	info->symbol = NULL;
+	info->symaddr = NULL;
+	info->offset = value - module->bias;
+
+	size_t j = findFloor(module->starts, module->nsyms, value);
+	if(j < module->nsyms){
+		// a symbol without size covers everything up to the next one
+		const SymEntry &sym = module->syms[j];
+		if(!sym.size || value < module->starts[j] + sym.size){
+			info->symbol = sym.name;
+			info->symaddr = (void *)module->starts[j];
+			info->offset = value - module->starts[j];
+		}
+	}
+
+	return true;
+}
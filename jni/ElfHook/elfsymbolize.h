@@ -0,0 +1,38 @@
+/*
+ * elfsymbolize.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFSYMBOLIZE_H_
+#define ELFSYMBOLIZE_H_
+
+#include <stddef.h>
+
+/**
+ * 地址反查的结果, 字符串属于索引, 模块卸载之前一直有效
+ */
+struct ElfSymbolInfo {
+	const char *soname;
+	void *base;
+
+	// 包含地址的函数, 找不到时symbol为NULL, offset为相对base的偏移
+	const char *symbol;
+	void *symaddr;
+	size_t offset;
+};
+
+/**
+ * 为所有已加载模块建立地址索引, 函数来自.dynsym中的STT_FUNC, 文件可读时再加上.symtab
+ * 加载或卸载模块后需要再次调用, 没有变化的模块复用已有索引. 返回模块个数
+ */
+int elfSymbolizeRefresh();
+
+/**
+ * 查找addr所在的模块和函数, 只做二分查找, 不分配内存也不加锁, 可以在hook和信号处理中调用
+ * 不在任何已索引的模块中时返回false
+ */
+bool elfSymbolize(const void *addr, ElfSymbolInfo *info);
+
+#endif /* ELFSYMBOLIZE_H_ */
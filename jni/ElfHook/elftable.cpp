@@ -0,0 +1,73 @@
+/*
+ * elftable.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "elfhook.h"
+
+// defined by the linker when any ELF_HOOK is present
+extern HookDecl __start_elf_hook_table[] __attribute__((weak, visibility("hidden")));
+extern HookDecl __stop_elf_hook_table[] __attribute__((weak, visibility("hidden")));
+
+static int compareDecl(const void *a, const void *b){
+	const char *l = (*(const HookDecl **)a)->soname;
+	const char *r = (*(const HookDecl **)b)->soname;
+
+	if(!l || !r){
+		return (l != NULL) - (r != NULL);
+	}
+	return strcmp(l, r);
+}
+
+static bool sameModule(const HookDecl *a, const HookDecl *b){
+	if(!a->soname || !b->soname){
+		return a->soname == b->soname;
+	}
+	return strcmp(a->soname, b->soname) == 0;
+}
+
+/**
+ * 在本so的构造函数中安装ELF_HOOK声明的所有hook, 早于任何调用本so的代码
+ */
+__attribute__((constructor)) static void installHookTable(){
+	const HookDecl *begin = __start_elf_hook_table;
+	const HookDecl *end = __stop_elf_hook_table;
+	if(!begin || end <= begin){
+		return;
+	}
+
+	size_t n = end - begin;
+	const HookDecl **decls = (const HookDecl **) malloc(sizeof(HookDecl *) * n);
+	HookSpec *specs = (HookSpec *) malloc(sizeof(HookSpec) * n);
+
+	for(size_t i = 0; i < n; i++){
+		decls[i] = begin + i;
+	}
+	qsort(decls, n, sizeof(HookDecl *), compareDecl);
+
+	int nmodules = 0, nfailed = 0;
+	for(size_t i = 0; i < n;){
+		size_t count = 0;
+		const HookDecl *first = decls[i];
+		for(; i < n && sameModule(decls[i], first); i++){
+			specs[count++] = decls[i]->spec;
+		}
+
+		if(elfHookMany(first->soname, specs, count)){
+			LOGE("[-] hook table of %s was not installed.", first->soname ? first->soname : "(main)");
+			nfailed++;
+		}
+		nmodules++;
+	}
+
+	free(specs);
+	free(decls);
+
+	LOGI("[+] hook table installed, %d hooks in %d modules, %d failed.", (int)n, nmodules, nfailed);
+}
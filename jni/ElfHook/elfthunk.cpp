@@ -0,0 +1,186 @@
+/*
+ * elfthunk.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "elfthunk.h"
+
+#define THUNK_SIZE 64
+#define THUNK_PAGE_SIZE 0x1000
+
+static uint8_t *thunk_page = NULL;
+static size_t thunk_used = THUNK_PAGE_SIZE;
+static pthread_mutex_t thunk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * 返回写入的字节数, 不支持的架构返回0
+ */
+static size_t writeThunk(uint8_t *thunk, void *context, void (*wrapper)()){
+	uintptr_t target = (uintptr_t)wrapper;
+	uintptr_t value = (uintptr_t)context;
+
+#if defined(__x86_64__)
+	// movabs r11, context; jmp [rip + 0]; .quad wrapper
+	static const uint8_t code[] = {0x49, 0xbb, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0x25, 0, 0, 0, 0};
+	memcpy(thunk, code, 16);
+	memcpy(thunk + 2, &value, 8);
+	memcpy(thunk + 16, &target, 8);
+	return 24;
+#elif defined(__aarch64__)
+	// ldr x17, #16; ldr x16, #20; br x16; nop; .quad context; .quad wrapper
+	static const uint32_t code[] = {0x58000091, 0x580000b0, 0xd61f0200, 0xd503201f};
+	memcpy(thunk, code, 16);
+	memcpy(thunk + 16, &value, 8);
+	memcpy(thunk + 24, &target, 8);
+	return 32;
+#elif defined(__arm__)
+	// arm mode: ldr ip, [pc]; ldr pc, [pc]; .word context; .word wrapper
+	static const uint32_t code[] = {0xe59fc000, 0xe59ff000};
+	memcpy(thunk, code, 8);
+	memcpy(thunk + 8, &value, 4);
+	memcpy(thunk + 12, &target, 4);
+	return 16;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * 返回写入的字节数, 不支持的架构或者offset不能编码时返回0
+ */
+static size_t writeGuardThunk(uint8_t *thunk, void *context, void (*wrapper)(), void **old_func, intptr_t offset, uint8_t mask){
+	uintptr_t target = (uintptr_t)wrapper;
+	uintptr_t value = (uintptr_t)context;
+	uintptr_t old = (uintptr_t)old_func;
+
+#if defined(__x86_64__)
+	if(offset != (int32_t)offset){
+		return 0;
+	}
+
+	// testb mask, %fs:offset; jnz 1f; movabs r11, context; jmp [rip + 13]
+	// 1: movabs r11, old_func; jmp [r11]; .quad wrapper
+	static const uint8_t code[] = {
+		0x64, 0xf6, 0x04, 0x25, 0, 0, 0, 0, 0, 0x75, 0x10,
+		0x49, 0xbb, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0x25, 0x0d, 0, 0, 0,
+		0x49, 0xbb, 0, 0, 0, 0, 0, 0, 0, 0, 0x41, 0xff, 0x23
+	};
+	int32_t disp = (int32_t)offset;
+	memcpy(thunk, code, 40);
+	memcpy(thunk + 4, &disp, 4);
+	thunk[8] = mask;
+	memcpy(thunk + 13, &value, 8);
+	memcpy(thunk + 29, &old, 8);
+	memcpy(thunk + 40, &target, 8);
+	return 48;
+#elif defined(__aarch64__)
+	if(offset < 0 || offset >= 0x1000000){
+		return 0;
+	}
+
+	// mrs x16, tpidr_el0; add x16, x16, #hi, lsl 12; ldrb w16, [x16, #lo]; tbnz w16, #bit, 1f
+	// ldr x17, #24; ldr x16, #28; br x16; 1: ldr x16, #28; ldr x16, [x16]; br x16
+	// .quad context; .quad wrapper; .quad old_func
+	uint32_t code[] = {
+		0xd53bd050, 0x91400210, 0x39400210, 0x37000090,
+		0x580000d1, 0x580000f0, 0xd61f0200,
+		0x580000f0, 0xf9400210, 0xd61f0200
+	};
+	code[1] |= (uint32_t)((offset >> 12) & 0xfff) << 10;
+	code[2] |= (uint32_t)(offset & 0xfff) << 10;
+	code[3] |= (uint32_t)__builtin_ctz(mask) << 19;
+	memcpy(thunk, code, 40);
+	memcpy(thunk + 40, &value, 8);
+	memcpy(thunk + 48, &target, 8);
+	memcpy(thunk + 56, &old, 8);
+	return 64;
+#elif defined(__arm__)
+	if(offset < 0 || offset >= 0x100000){
+		return 0;
+	}
+
+	// arm mode: mrc p15, 0, ip, c13, c0, 3; add ip, ip, #hi; ldrb ip, [ip, #lo]; tst ip, #mask; bne 1f
+	// ldr ip, [pc, #12]; ldr pc, [pc, #12]; 1: ldr ip, [pc, #12]; ldr ip, [ip]; bx ip
+	// .word context; .word wrapper; .word old_func
+	uint32_t code[] = {
+		0xee1dcf70, 0xe28cca00, 0xe5dcc000, 0xe31c0000, 0x1a000001,
+		0xe59fc00c, 0xe59ff00c, 0xe59fc00c, 0xe59cc000, 0xe12fff1c
+	};
+	code[1] |= (uint32_t)(offset >> 12) & 0xff;
+	code[2] |= (uint32_t)offset & 0xfff;
+	code[3] |= mask;
+	memcpy(thunk, code, 40);
+	memcpy(thunk + 40, &value, 4);
+	memcpy(thunk + 44, &target, 4);
+	memcpy(thunk + 48, &old, 4);
+	return 52;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * 从当前页中取一个thunk的空间, 页用完时分配新页, 调用时持有thunk_lock
+ */
+static uint8_t *allocThunk(){
+	if(thunk_used + THUNK_SIZE > THUNK_PAGE_SIZE){
+		void *page = mmap(NULL, THUNK_PAGE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(page == MAP_FAILED){
+			return NULL;
+		}
+
+		thunk_page = (uint8_t *)page;
+		thunk_used = 0;
+	}
+
+	return thunk_page + thunk_used;
+}
+
+void *createWrapperThunk(void *context, void (*wrapper)()){
+	pthread_mutex_lock(&thunk_lock);
+
+	uint8_t *thunk = allocThunk();
+	size_t size = thunk ? writeThunk(thunk, context, wrapper) : 0;
+	if(!size){
+		pthread_mutex_unlock(&thunk_lock);
+		return NULL;
+	}
+	thunk_used += THUNK_SIZE;
+
+	pthread_mutex_unlock(&thunk_lock);
+
+	__builtin___clear_cache((char *)thunk, (char *)thunk + size);
+	return thunk;
+}
+
+void *createGuardThunk(void *context, void (*wrapper)(), void **old_func, intptr_t offset, uint8_t mask){
+	pthread_mutex_lock(&thunk_lock);
+
+	uint8_t *thunk = allocThunk();
+	size_t size = thunk ? writeGuardThunk(thunk, context, wrapper, old_func, offset, mask) : 0;
+	if(!size){
+		pthread_mutex_unlock(&thunk_lock);
+		return NULL;
+	}
+	thunk_used += THUNK_SIZE;
+
+	pthread_mutex_unlock(&thunk_lock);
+
+	__builtin___clear_cache((char *)thunk, (char *)thunk + size);
+	return thunk;
+}
+
+void releaseWrapperThunk(void *thunk){
+	pthread_mutex_lock(&thunk_lock);
+	if((uint8_t *)thunk + THUNK_SIZE == thunk_page + thunk_used){
+		thunk_used -= THUNK_SIZE;
+	}
+	pthread_mutex_unlock(&thunk_lock);
+}
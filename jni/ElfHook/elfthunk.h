@@ -0,0 +1,31 @@
+/*
+ * elfthunk.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFTHUNK_H_
+#define ELFTHUNK_H_
+
+#include <stdint.h>
+
+/**
+ * 生成一段把context交给wrapper的代码, 写入槽后调用者经过它进入wrapper
+ * wrapper从x86-64的r11, arm64的x17, arm的ip取得context
+ * 不支持的架构或内存不足时返回NULL
+ */
+void *createWrapperThunk(void *context, void (*wrapper)());
+
+/**
+ * 同createWrapperThunk, 但先检查线程指针加offset处字节中的mask位, 已设置时直接跳到*old_func
+ * offset不能编码进指令或者不支持的架构时返回NULL
+ */
+void *createGuardThunk(void *context, void (*wrapper)(), void **old_func, intptr_t offset, uint8_t mask);
+
+/**
+ * 归还一个还没有写入任何槽的thunk, 只有最近分配的那个会被重用
+ */
+void releaseWrapperThunk(void *thunk);
+
+#endif /* ELFTHUNK_H_ */
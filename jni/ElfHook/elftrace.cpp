@@ -0,0 +1,301 @@
+/*
+ * elftrace.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+#include "elftrace.h"
+
+#define CACHE_LINE 64
+#define MIN_RING_EVENTS 64
+
+/**
+ * 一个线程的单生产者单消费者环形缓冲区, 线程退出后留给新线程复用
+ * head只由生产者写, tail只由后台线程写, 分别放在不同的cache line
+ */
+struct TraceRing {
+	TraceRing *next;
+	TraceEvent *events;
+	uint64_t mask;
+	size_t mapsize;
+
+	// 1 while a thread owns the ring
+	int owner;
+	uint32_t tid;
+
+	uint64_t head __attribute__((aligned(CACHE_LINE)));
+	uint64_t cached_tail;
+	uint64_t dropped;
+
+	uint64_t tail __attribute__((aligned(CACHE_LINE)));
+};
+
+static TraceRing *rings = NULL;
+
+static pthread_key_t trace_key;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool running = false;
+static bool stopping = false;
+static int trace_fd = -1;
+static pthread_t drain_thread;
+static size_t ring_events = 0;
+static int drain_interval_ms = 0;
+
+static inline uint64_t nowNs(){
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void releaseRing(void *data){
+	TraceRing *ring = (TraceRing *)data;
+	__atomic_store_n(&ring->owner, 0, __ATOMIC_RELEASE);
+}
+
+static void createTraceKey(){
+	pthread_key_create(&trace_key, releaseRing);
+}
+
+static TraceRing *allocRing(size_t nevents){
+	size_t header = (sizeof(TraceRing) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+	size_t mapsize = header + nevents * sizeof(TraceEvent);
+
+	// not malloc, the ring may be created inside a hooked malloc
+	void *data = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(data == MAP_FAILED){
+		return NULL;
+	}
+
+	TraceRing *ring = (TraceRing *)data;
+	ring->events = (TraceEvent *)((uint8_t *)data + header);
+	ring->mask = nevents - 1;
+	ring->mapsize = mapsize;
+	ring->owner = 1;
+
+	ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+	}
+
+	return ring;
+}
+
+static TraceRing *getRing(){
+	TraceRing *ring = (TraceRing *) pthread_getspecific(trace_key);
+	if(ring){
+		return ring;
+	}
+
+	// a ring left by an exited thread, its events are still drained in order
+	for(TraceRing *it = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); it; it = it->next){
+		int expected = 0;
+		if(__atomic_compare_exchange_n(&it->owner, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+			ring = it;
+			break;
+		}
+	}
+
+	if(!ring){
+		ring = allocRing(__atomic_load_n(&ring_events, __ATOMIC_RELAXED));
+		if(!ring){
+			return NULL;
+		}
+	}
+
+	ring->tid = syscall(__NR_gettid);
+	pthread_setspecific(trace_key, ring);
+	return ring;
+}
+
+void elfTraceEvent(uint32_t hook, const void *ret_addr, const uintptr_t *args, int nargs){
+	if(!__atomic_load_n(&running, __ATOMIC_ACQUIRE)){
+		return;
+	}
+
+	TraceRing *ring = getRing();
+	if(!ring){
+		return;
+	}
+
+	uint64_t head = ring->head;
+	if(head - ring->cached_tail > ring->mask){
+		ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if(head - ring->cached_tail > ring->mask){
+			__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	TraceEvent &event = ring->events[head & ring->mask];
+	event.hook = hook;
+	event.tid = ring->tid;
+	event.timestamp = nowNs();
+	event.ret_addr = (uintptr_t)ret_addr;
+
+	int i = 0;
+	for(; i < nargs && i < TRACE_MAX_ARGS; i++){
+		event.args[i] = args[i];
+	}
+	for(; i < TRACE_MAX_ARGS; i++){
+		event.args[i] = 0;
+	}
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t elfTraceDropped(){
+	uint64_t dropped = 0;
+	for(TraceRing *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next){
+		dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	}
+	return dropped;
+}
+
+static bool writeAll(int fd, const void *data, size_t size){
+	const uint8_t *p = (const uint8_t *)data;
+	while(size){
+		ssize_t n = write(fd, p, size);
+		if(n < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+/**
+ * 把ring中已提交的记录直接从缓冲区写入文件, 写完才移动tail
+ */
+static size_t drainRing(TraceRing *ring){
+	uint64_t tail = ring->tail;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint64_t capacity = ring->mask + 1;
+	size_t ndrained = 0;
+
+	while(tail != head){
+		uint64_t index = tail & ring->mask;
+		uint64_t count = head - tail < capacity - index ? head - tail : capacity - index;
+
+		if(!writeAll(trace_fd, ring->events + index, count * sizeof(TraceEvent))){
+			LOGE("[-] could not write the trace, %s.", strerror(errno));
+		}
+
+		tail += count;
+		ndrained += count;
+	}
+
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	return ndrained;
+}
+
+static size_t drainRings(){
+	size_t ndrained = 0;
+	for(TraceRing *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next){
+		ndrained += drainRing(ring);
+	}
+	return ndrained;
+}
+
+static void *drainMain(void *){
+	while(!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)){
+		if(!drainRings()){
+			usleep(drain_interval_ms * 1000);
+		}
+	}
+
+	drainRings();
+	return NULL;
+}
+
+int elfTraceStart(const char *path, size_t nevents, int interval_ms){
+	pthread_once(&trace_once, createTraceKey);
+	pthread_mutex_lock(&trace_lock);
+
+	if(running){
+		pthread_mutex_unlock(&trace_lock);
+		LOGE("[-] tracing has been started.");
+		return -1;
+	}
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0){
+		pthread_mutex_unlock(&trace_lock);
+		LOGE("[-] could not open %s, %s.", path, strerror(errno));
+		return -1;
+	}
+
+	TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceEvent), 0};
+	if(!writeAll(fd, &header, sizeof(header))){
+		close(fd);
+		pthread_mutex_unlock(&trace_lock);
+		return -1;
+	}
+
+	// rings of an earlier session keep their size
+	size_t size = MIN_RING_EVENTS;
+	while(size < nevents){
+		size <<= 1;
+	}
+	__atomic_store_n(&ring_events, size, __ATOMIC_RELAXED);
+
+	// events written after the last session stopped are stale
+	for(TraceRing *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next){
+		__atomic_store_n(&ring->tail, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+	}
+
+	trace_fd = fd;
+	drain_interval_ms = interval_ms > 0 ? interval_ms : 1;
+	stopping = false;
+
+	if(pthread_create(&drain_thread, NULL, drainMain, NULL)){
+		trace_fd = -1;
+		close(fd);
+		pthread_mutex_unlock(&trace_lock);
+		LOGE("[-] could not start the trace thread.");
+		return -1;
+	}
+
+	__atomic_store_n(&running, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&trace_lock);
+
+	LOGI("[+] tracing to %s, %d events per thread.", path, (int)size);
+	return 0;
+}
+
+int elfTraceStop(){
+	pthread_mutex_lock(&trace_lock);
+
+	if(!running){
+		pthread_mutex_unlock(&trace_lock);
+		return -1;
+	}
+
+	__atomic_store_n(&running, false, __ATOMIC_RELEASE);
+	__atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+	pthread_join(drain_thread, NULL);
+
+	close(trace_fd);
+	trace_fd = -1;
+
+	pthread_mutex_unlock(&trace_lock);
+
+	LOGI("[+] tracing stopped, %d events dropped.", (int)elfTraceDropped());
+	return 0;
+}
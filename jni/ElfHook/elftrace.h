@@ -0,0 +1,62 @@
+/*
+ * elftrace.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFTRACE_H_
+#define ELFTRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TRACE_MAGIC 0x43525448	// "HTRC"
+#define TRACE_VERSION 1
+
+#define TRACE_MAX_ARGS 5
+
+/**
+ * 一条定长的调用记录, 64字节
+ */
+struct TraceEvent {
+	uint32_t hook;
+	uint32_t tid;
+	uint64_t timestamp;	// CLOCK_MONOTONIC, ns
+	uint64_t ret_addr;
+	uint64_t args[TRACE_MAX_ARGS];
+};
+
+/**
+ * 文件头, 之后是连续的TraceEvent
+ */
+struct TraceHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t event_size;
+	uint32_t reserved;
+};
+
+/**
+ * 开始记录到path, 每个线程一个能放ring_events条记录的环形缓冲区,
+ * 后台线程每隔interval_ms毫秒把它们写入文件
+ */
+int elfTraceStart(const char *path, size_t ring_events, int interval_ms);
+
+/**
+ * 写出剩余的记录后停止, 关闭文件
+ */
+int elfTraceStop();
+
+/**
+ * 在当前线程的缓冲区追加一条记录, 只写本线程的缓冲区, 不加锁
+ * 缓冲区满时丢弃并计数, 不会阻塞, 未开始记录时直接返回
+ */
+void elfTraceEvent(uint32_t hook, const void *ret_addr, const uintptr_t *args, int nargs);
+
+/**
+ * 因缓冲区满而丢弃的记录数
+ */
+uint64_t elfTraceDropped();
+
+#endif /* ELFTRACE_H_ */
@@ -0,0 +1,162 @@
+/*
+ * elftraits.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ELFTRAITS_H_
+#define ELFTRAITS_H_
+
+#include <elf.h>
+#include <stdint.h>
+
+// some old ndk elf.h have no aarch64/x86 relocation ids
+#ifndef EM_AARCH64
+#define EM_AARCH64 183
+#endif
+#ifndef EM_X86_64
+#define EM_X86_64 62
+#endif
+#ifndef R_AARCH64_ABS64
+#define R_AARCH64_ABS64 257
+#endif
+#ifndef R_AARCH64_GLOB_DAT
+#define R_AARCH64_GLOB_DAT 1025
+#endif
+#ifndef R_AARCH64_JUMP_SLOT
+#define R_AARCH64_JUMP_SLOT 1026
+#endif
+#ifndef R_386_32
+#define R_386_32 1
+#endif
+#ifndef R_386_GLOB_DAT
+#define R_386_GLOB_DAT 6
+#endif
+#ifndef R_386_JMP_SLOT
+#define R_386_JMP_SLOT 7
+#endif
+#ifndef R_X86_64_64
+#define R_X86_64_64 1
+#endif
+#ifndef R_X86_64_GLOB_DAT
+#define R_X86_64_GLOB_DAT 6
+#endif
+#ifndef R_X86_64_JUMP_SLOT
+#define R_X86_64_JUMP_SLOT 7
+#endif
+#ifndef NT_GNU_BUILD_ID
+#define NT_GNU_BUILD_ID 3
+#endif
+#ifndef DT_VERSYM
+#define DT_VERSYM 0x6ffffff0
+#endif
+#ifndef DT_VERDEF
+#define DT_VERDEF 0x6ffffffc
+#define DT_VERDEFNUM 0x6ffffffd
+#endif
+#ifndef DT_VERNEED
+#define DT_VERNEED 0x6ffffffe
+#define DT_VERNEEDNUM 0x6fffffff
+#endif
+#ifndef VERSYM_HIDDEN
+#define VERSYM_HIDDEN 0x8000
+#endif
+
+/**
+ * ELF32类型
+ */
+struct Elf32Class {
+	typedef Elf32_Ehdr Ehdr;
+	typedef Elf32_Phdr Phdr;
+	typedef Elf32_Shdr Shdr;
+	typedef Elf32_Dyn Dyn;
+	typedef Elf32_Sym Sym;
+	typedef Elf32_Half Half;
+	typedef Elf32_Word Word;
+	typedef Elf32_Addr Addr;
+	typedef Elf32_Versym Versym;
+	typedef Elf32_Verdef Verdef;
+	typedef Elf32_Verdaux Verdaux;
+	typedef Elf32_Verneed Verneed;
+	typedef Elf32_Vernaux Vernaux;
+
+	enum { ELFCLASS = ELFCLASS32 };
+
+	static inline uint32_t rSym(Elf32_Word info) { return ELF32_R_SYM(info); }
+	static inline uint32_t rType(Elf32_Word info) { return ELF32_R_TYPE(info); }
+	static inline uint8_t stType(uint8_t info) { return ELF32_ST_TYPE(info); }
+};
+
+/**
+ * ELF64类型
+ */
+struct Elf64Class {
+	typedef Elf64_Ehdr Ehdr;
+	typedef Elf64_Phdr Phdr;
+	typedef Elf64_Shdr Shdr;
+	typedef Elf64_Dyn Dyn;
+	typedef Elf64_Sym Sym;
+	typedef Elf64_Half Half;
+	typedef Elf64_Word Word;
+	typedef Elf64_Addr Addr;
+	typedef Elf64_Versym Versym;
+	typedef Elf64_Verdef Verdef;
+	typedef Elf64_Verdaux Verdaux;
+	typedef Elf64_Verneed Verneed;
+	typedef Elf64_Vernaux Vernaux;
+
+	enum { ELFCLASS = ELFCLASS64 };
+
+	static inline uint32_t rSym(Elf64_Xword info) { return ELF64_R_SYM(info); }
+	static inline uint32_t rType(Elf64_Xword info) { return ELF64_R_TYPE(info); }
+	static inline uint8_t stType(uint8_t info) { return ELF64_ST_TYPE(info); }
+};
+
+/**
+ * ELF类型 + 重定位格式(REL/RELA) + 架构相关的重定位类型
+ * 所有值都是编译期常量, 重定位扫描循环会针对每个架构单独展开
+ */
+template<class C, class R, int RelTag, int RelSzTag, uint32_t JumpSlot, uint32_t GlobDat, uint32_t Abs, uint16_t Machine>
+struct ElfArchTraits : C {
+	typedef R Rel;
+
+	enum {
+		DT_RELTAB = RelTag,
+		DT_RELTABSZ = RelSzTag,
+		MACHINE = Machine
+	};
+
+	static const uint32_t R_JUMP_SLOT = JumpSlot;
+	static const uint32_t R_GLOB_DAT = GlobDat;
+	static const uint32_t R_ABS = Abs;
+};
+
+typedef ElfArchTraits<Elf32Class, Elf32_Rel, DT_REL, DT_RELSZ,
+		R_ARM_JUMP_SLOT, R_ARM_GLOB_DAT, R_ARM_ABS32, EM_ARM> ElfArm;
+
+typedef ElfArchTraits<Elf64Class, Elf64_Rela, DT_RELA, DT_RELASZ,
+		R_AARCH64_JUMP_SLOT, R_AARCH64_GLOB_DAT, R_AARCH64_ABS64, EM_AARCH64> ElfArm64;
+
+typedef ElfArchTraits<Elf32Class, Elf32_Rel, DT_REL, DT_RELSZ,
+		R_386_JMP_SLOT, R_386_GLOB_DAT, R_386_32, EM_386> ElfX86;
+
+typedef ElfArchTraits<Elf64Class, Elf64_Rela, DT_RELA, DT_RELASZ,
+		R_X86_64_JUMP_SLOT, R_X86_64_GLOB_DAT, R_X86_64_64, EM_X86_64> ElfX86_64;
+
+/**
+ * 当前进程的ELF类型
+ */
+#if defined(__aarch64__)
+typedef ElfArm64 ElfNative;
+#elif defined(__arm__)
+typedef ElfArm ElfNative;
+#elif defined(__x86_64__)
+typedef ElfX86_64 ElfNative;
+#elif defined(__i386__)
+typedef ElfX86 ElfNative;
+#else
+#error "unsupported architecture"
+#endif
+
+#endif /* ELFTRAITS_H_ */
@@ -17,13 +17,14 @@
 #include "common.h"
 #include "elfutils.h"
 
-static inline Elf32_Shdr *findSectionByName(ElfInfo &info, const char *sname){
-	Elf32_Shdr *target = NULL;
-	Elf32_Shdr *shdr = info.shdr;
+template<class T>
+static inline typename T::Shdr *findSectionByName(ElfInfoT<T> &info, const char *sname){
+	typename T::Shdr *target = NULL;
+	typename T::Shdr *shdr = info.shdr;
 	for(int i=0; i<info.ehdr->e_shnum; i++){
 		const char *name = (const char *)(shdr[i].sh_name + info.shstr);
 		if(!strncmp(name, sname, strlen(sname))){
-			target = (Elf32_Shdr *)(shdr + i);
+			target = (typename T::Shdr *)(shdr + i);
 			break;
 		}
 	}
@@ -31,11 +32,12 @@ static inline Elf32_Shdr *findSectionByName(ElfInfo &info, const char *sname){
 	return target;
 }
 
-static inline Elf32_Phdr *findSegmentByType(ElfInfo &info, const Elf32_Word type){
-	Elf32_Phdr *target = NULL;
-	Elf32_Phdr *phdr = info.phdr;
+template<class T>
+static inline typename T::Phdr *findSegmentByType(ElfInfoT<T> &info, const typename T::Word type){
+	typename T::Phdr *target = NULL;
+	typename T::Phdr *phdr = info.phdr;
 
-	for(int i=0; i<info.ehdr->e_phnum; i++){
+	for(int i=0; i<info.phnum; i++){
 		if(phdr[i].p_type == type){
 			target = phdr + i;
 			break;
@@ -47,13 +49,13 @@ static inline Elf32_Phdr *findSegmentByType(ElfInfo &info, const Elf32_Word type
 
 
 #define SAFE_SET_VALUE(t, v) if(t) *(t) = (v)
-template<class T>
-static inline void getSectionInfo(ElfInfo &info, const char *name, Elf32_Word *pSize, Elf32_Shdr **ppShdr, T *data){
-	Elf32_Shdr *_shdr = findSectionByName(info, name);
+template<class T, class D>
+static inline void getSectionInfo(ElfInfoT<T> &info, const char *name, typename T::Word *pSize, typename T::Shdr **ppShdr, D *data){
+	typename T::Shdr *_shdr = findSectionByName(info, name);
 
 	if(_shdr){
 		SAFE_SET_VALUE(pSize, _shdr->sh_size / _shdr->sh_entsize);
-		SAFE_SET_VALUE(data, reinterpret_cast<T>(info.elf_base + _shdr->sh_offset));
+		SAFE_SET_VALUE(data, reinterpret_cast<D>(info.elf_base + _shdr->sh_offset));
 	}else{
 		LOGE("[-] Could not found section %s\n", name);
 		exit(-1);
@@ -62,17 +64,17 @@ static inline void getSectionInfo(ElfInfo &info, const char *name, Elf32_Word *p
 	SAFE_SET_VALUE(ppShdr, _shdr);
 }
 
-template<class T>
-static void getSegmentInfo(ElfInfo &info, const Elf32_Word type, Elf32_Phdr **ppPhdr, Elf32_Word *pSize, T *data){
-	Elf32_Phdr *_phdr = findSegmentByType(info, type);
+template<class T, class D>
+static void getSegmentInfo(ElfInfoT<T> &info, const typename T::Word type, typename T::Phdr **ppPhdr, typename T::Word *pSize, D *data){
+	typename T::Phdr *_phdr = findSegmentByType(info, type);
 
 	if(_phdr){
 
 		if(info.handle->fromfile){ //文件读取
-			SAFE_SET_VALUE(data, reinterpret_cast<T>(info.elf_base + _phdr->p_offset));
+			SAFE_SET_VALUE(data, reinterpret_cast<D>(info.elf_base + _phdr->p_offset));
 			SAFE_SET_VALUE(pSize, _phdr->p_filesz);
 		}else{ //从内存读取
-			SAFE_SET_VALUE(data, reinterpret_cast<T>(info.elf_base + _phdr->p_vaddr));
+			SAFE_SET_VALUE(data, reinterpret_cast<D>(info.elf_base + _phdr->p_vaddr));
 			SAFE_SET_VALUE(pSize, _phdr->p_memsz);
 		}
 
@@ -84,6 +86,18 @@ static void getSegmentInfo(ElfInfo &info, const Elf32_Word type, Elf32_Phdr **pp
 	SAFE_SET_VALUE(ppPhdr, _phdr);
 }
 
+/**
+ * glibc relocates the d_ptr of the in-memory .dynamic in place, bionic does not
+ */
+template<class T>
+static inline uint8_t *getDynPtr(ElfInfoT<T> &info, typename T::Addr ptr){
+	if(!info.handle->fromfile && ptr >= (uintptr_t)info.elf_base){
+		return reinterpret_cast<uint8_t *>(ptr);
+	}
+
+	return info.elf_base + ptr;
+}
+
 unsigned elf_hash(const char *name) {
 	const unsigned char *tmp = (const unsigned char *) name;
 	unsigned h = 0, g;
@@ -97,24 +111,103 @@ unsigned elf_hash(const char *name) {
 	return h;
 }
 
-void getElfInfoBySectionView(ElfInfo &info, const ElfHandle *handle){
+uint32_t gnu_hash(const char *name) {
+	const unsigned char *tmp = (const unsigned char *) name;
+	uint32_t h = 5381;
+
+	while (*tmp) {
+		h = (h << 5) + h + *tmp++;
+	}
+	return h;
+}
+
+/**
+ * 解析DT_GNU_HASH, .gnu.hash不包含符号个数, 需要遍历最后一个bucket的链得到
+ */
+template<class T>
+static void setGnuHashInfo(ElfInfoT<T> &info, uint32_t *rawdata){
+	info.gnu_nbucket = rawdata[0];
+	info.gnu_symoffset = rawdata[1];
+	info.gnu_maskwords = rawdata[2];
+	info.gnu_shift2 = rawdata[3];
+	info.gnu_bloom = reinterpret_cast<typename T::Addr *>(rawdata + 4);
+	info.gnu_bucket = reinterpret_cast<uint32_t *>(info.gnu_bloom + info.gnu_maskwords);
+	info.gnu_chain = info.gnu_bucket + info.gnu_nbucket - info.gnu_symoffset;
+
+	if(info.symsz){
+		return;
+	}
+
+	uint32_t last = 0;
+	for(uint32_t i=0; i<info.gnu_nbucket; i++){
+		if(info.gnu_bucket[i] > last){
+			last = info.gnu_bucket[i];
+		}
+	}
+
+	if(last < info.gnu_symoffset){
+		info.symsz = info.gnu_symoffset;
+		return;
+	}
+
+	while(!(info.gnu_chain[last] & 1)){
+		last++;
+	}
+	info.symsz = last + 1;
+}
+
+/**
+ * 在一个PT_NOTE中查找NT_GNU_BUILD_ID
+ */
+template<class T>
+static void setBuildId(ElfInfoT<T> &info, const uint8_t *notes, size_t size, size_t align){
+	align = align == 8 ? 8 : 4;
+	const uint8_t *end = notes + size;
+
+	while(notes + sizeof(Elf32_Nhdr) <= end){
+		const Elf32_Nhdr *nhdr = reinterpret_cast<const Elf32_Nhdr *>(notes);
+		const uint8_t *name = notes + sizeof(Elf32_Nhdr);
+		const uint8_t *desc = name + ((nhdr->n_namesz + align - 1) & ~(align - 1));
+
+		if(desc + nhdr->n_descsz > end){
+			break;
+		}
+
+		if(nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && !memcmp(name, "GNU", 4)){
+			info.build_id = desc;
+			info.build_idsz = nhdr->n_descsz;
+			return;
+		}
+
+		notes = desc + ((nhdr->n_descsz + align - 1) & ~(align - 1));
+	}
+}
+
+template<class T>
+void getElfInfoBySectionView(ElfInfoT<T> &info, const ElfHandle *handle){
+	typedef typename T::Shdr Shdr;
 
+	memset(&info, 0, sizeof(info));
 	info.handle = handle;
 	info.elf_base = (uint8_t *) handle->base;
-	info.ehdr = reinterpret_cast<Elf32_Ehdr *>(info.elf_base);
-	info.shdr = reinterpret_cast<Elf32_Shdr *>(info.elf_base + info.ehdr->e_shoff);
-	info.phdr = reinterpret_cast<Elf32_Phdr *>(info.elf_base + info.ehdr->e_phoff);
+	info.ehdr = reinterpret_cast<typename T::Ehdr *>(info.elf_base);
+	info.shdr = reinterpret_cast<Shdr *>(info.elf_base + info.ehdr->e_shoff);
+	info.phdr = reinterpret_cast<typename T::Phdr *>(info.elf_base + info.ehdr->e_phoff);
+	info.phnum = info.ehdr->e_phnum;
 
-	Elf32_Shdr *shstr = (Elf32_Shdr *)(info.shdr + info.ehdr->e_shstrndx);
+	Shdr *shstr = (Shdr *)(info.shdr + info.ehdr->e_shstrndx);
 	info.shstr = reinterpret_cast<char *>(info.elf_base + shstr->sh_offset);
 
+	const char *reldyn = T::DT_RELTAB == DT_RELA ? ".rela.dyn" : ".rel.dyn";
+	const char *relplt = T::DT_RELTAB == DT_RELA ? ".rela.plt" : ".rel.plt";
+
 	getSectionInfo(info, ".dynstr", NULL, NULL, &info.symstr);
 	getSectionInfo(info, ".dynamic", &info.dynsz, NULL, &info.dyn);
 	getSectionInfo(info, ".dynsym", &info.symsz, NULL, &info.sym);
-	getSectionInfo(info, ".rel.dyn", &info.reldynsz, NULL, &info.reldyn);
-	getSectionInfo(info, ".rel.plt", &info.relpltsz, NULL, &info.relplt);
+	getSectionInfo(info, reldyn, &info.reldynsz, NULL, &info.reldyn);
+	getSectionInfo(info, relplt, &info.relpltsz, NULL, &info.relplt);
 
-	Elf32_Shdr *hash = findSectionByName(info, ".hash");
+	Shdr *hash = findSectionByName(info, ".hash");
 	if(hash){
 		uint32_t *rawdata = reinterpret_cast<uint32_t *>(info.elf_base + hash->sh_offset);
 		info.nbucket = rawdata[0];
@@ -122,61 +215,133 @@ void getElfInfoBySectionView(ElfInfo &info, const ElfHandle *handle){
 		info.bucket = rawdata + 2;
 		info.chain = info.bucket + info.nbucket;
 	}
+
+	Shdr *gnuhash = findSectionByName(info, ".gnu.hash");
+	if(gnuhash){
+		setGnuHashInfo(info, reinterpret_cast<uint32_t *>(info.elf_base + gnuhash->sh_offset));
+	}
 }
 
-void getElfInfoBySegmentView(ElfInfo &info, const ElfHandle *handle){
+template<class T>
+void getElfInfoBySegmentView(ElfInfoT<T> &info, const ElfHandle *handle){
+	typedef typename T::Dyn Dyn;
+	typedef typename T::Rel Rel;
 
+	memset(&info, 0, sizeof(info));
 	info.handle = handle;
 	info.elf_base = (uint8_t *) handle->base;
-	info.ehdr = reinterpret_cast<Elf32_Ehdr *>(info.elf_base);
+
+	if(handle->phdr){
+		// loaded module, base is the load bias and the ehdr lives in the first PT_LOAD
+		info.phdr = reinterpret_cast<typename T::Phdr *>(const_cast<void *>(handle->phdr));
+		info.phnum = handle->phnum;
+
+		for(int i=0; i<info.phnum; i++){
+			if(info.phdr[i].p_type == PT_LOAD && info.phdr[i].p_offset == 0){
+				info.ehdr = reinterpret_cast<typename T::Ehdr *>(info.elf_base + info.phdr[i].p_vaddr);
+				break;
+			}
+		}
+	}else{
+		info.ehdr = reinterpret_cast<typename T::Ehdr *>(info.elf_base);
+		info.phdr = reinterpret_cast<typename T::Phdr *>(info.elf_base + info.ehdr->e_phoff);
+		info.phnum = info.ehdr->e_phnum;
+	}
 
 	// may be wrong
-	info.shdr = reinterpret_cast<Elf32_Shdr *>(info.elf_base + info.ehdr->e_shoff);
-	info.phdr = reinterpret_cast<Elf32_Phdr *>(info.elf_base + info.ehdr->e_phoff);
+	if(info.ehdr){
+		info.shdr = reinterpret_cast<typename T::Shdr *>((uint8_t *)info.ehdr + info.ehdr->e_shoff);
+	}
 
 	info.shstr = NULL;
 
-	Elf32_Phdr *dynamic = NULL;
-	Elf32_Word size = 0;
+	typename T::Phdr *dynamic = NULL;
+	typename T::Word size = 0;
 
 	getSegmentInfo(info, PT_DYNAMIC, &dynamic, &size, &info.dyn);
 	if(!dynamic){
 		LOGE("[-] could't find PT_DYNAMIC segment");
 		exit(-1);
 	}
-	info.dynsz = size / sizeof(Elf32_Dyn);
+	info.dynsz = size / sizeof(Dyn);
 
-	Elf32_Dyn *dyn = info.dyn;
-	for(int i=0; i<info.dynsz; i++, dyn++){
+	uint32_t *gnuhash = NULL;
+
+	Dyn *dyn = info.dyn;
+	for(size_t i=0; i<info.dynsz; i++, dyn++){
 
 		switch(dyn->d_tag){
 
 		case DT_SYMTAB:
-			info.sym = reinterpret_cast<Elf32_Sym *>(info.elf_base + dyn->d_un.d_ptr);
+			info.sym = reinterpret_cast<typename T::Sym *>(getDynPtr(info, dyn->d_un.d_ptr));
 			break;
 
 		case DT_STRTAB:
-			info.symstr = reinterpret_cast<const char *>(info.elf_base + dyn->d_un.d_ptr);
+			info.symstr = reinterpret_cast<const char *>(getDynPtr(info, dyn->d_un.d_ptr));
 			break;
 
-		case DT_REL:
-			info.reldyn = reinterpret_cast<Elf32_Rel *>(info.elf_base + dyn->d_un.d_ptr);
+		case T::DT_RELTAB:
+			info.reldyn = reinterpret_cast<Rel *>(getDynPtr(info, dyn->d_un.d_ptr));
 			break;
 
-		case DT_RELSZ:
-			info.reldynsz = dyn->d_un.d_val / sizeof(Elf32_Rel);
+		case T::DT_RELTABSZ:
+			info.reldynsz = dyn->d_un.d_val / sizeof(Rel);
 			break;
 
 		case DT_JMPREL:
-			info.relplt = reinterpret_cast<Elf32_Rel *>(info.elf_base + dyn->d_un.d_ptr);
+			info.relplt = reinterpret_cast<Rel *>(getDynPtr(info, dyn->d_un.d_ptr));
 			break;
 
 		case DT_PLTRELSZ:
-			info.relpltsz = dyn->d_un.d_val / sizeof(Elf32_Rel);
+			info.relpltsz = dyn->d_un.d_val / sizeof(Rel);
+			break;
+
+		case DT_ANDROID_REL:
+		case DT_ANDROID_RELA:
+			info.packed_rel = getDynPtr(info, dyn->d_un.d_ptr);
+			break;
+
+		case DT_ANDROID_RELSZ:
+		case DT_ANDROID_RELASZ:
+			info.packed_relsz = dyn->d_un.d_val;
+			break;
+
+		case DT_RELR:
+		case DT_ANDROID_RELR:
+			info.relr = reinterpret_cast<typename T::Addr *>(getDynPtr(info, dyn->d_un.d_ptr));
+			break;
+
+		case DT_RELRSZ:
+		case DT_ANDROID_RELRSZ:
+			info.relrsz = dyn->d_un.d_val / sizeof(typename T::Addr);
+			break;
+
+		case DT_GNU_HASH:
+			gnuhash = reinterpret_cast<uint32_t *>(getDynPtr(info, dyn->d_un.d_ptr));
+			break;
+
+		case DT_VERSYM:
+			info.versym = reinterpret_cast<typename T::Versym *>(getDynPtr(info, dyn->d_un.d_ptr));
+			break;
+
+		case DT_VERDEF:
+			info.verdef = reinterpret_cast<typename T::Verdef *>(getDynPtr(info, dyn->d_un.d_ptr));
+			break;
+
+		case DT_VERDEFNUM:
+			info.verdefnum = dyn->d_un.d_val;
+			break;
+
+		case DT_VERNEED:
+			info.verneed = reinterpret_cast<typename T::Verneed *>(getDynPtr(info, dyn->d_un.d_ptr));
+			break;
+
+		case DT_VERNEEDNUM:
+			info.verneednum = dyn->d_un.d_val;
 			break;
 
 		case DT_HASH:
-			uint32_t *rawdata = reinterpret_cast<uint32_t *>(info.elf_base + dyn->d_un.d_ptr);
+			uint32_t *rawdata = reinterpret_cast<uint32_t *>(getDynPtr(info, dyn->d_un.d_ptr));
 			info.nbucket = rawdata[0];
 			info.nchain = rawdata[1];
 			info.bucket = rawdata + 2;
@@ -187,66 +352,517 @@ void getElfInfoBySegmentView(ElfInfo &info, const ElfHandle *handle){
 		}
 	}
 
+	// symsz comes from DT_HASH if any, so parse .gnu.hash at last
+	if(gnuhash){
+		setGnuHashInfo(info, gnuhash);
+	}
+
+	for(int i=0; i<info.phnum && !info.build_id; i++){
+		typename T::Phdr &phdr = info.phdr[i];
+		if(phdr.p_type == PT_NOTE){
+			uint8_t *notes = info.elf_base + (handle->fromfile ? phdr.p_offset : phdr.p_vaddr);
+			setBuildId(info, notes, phdr.p_filesz, phdr.p_align);
+		}
+	}
 }
 
-void findSymByName(ElfInfo &info, const char *symbol, Elf32_Sym **sym, int *symidx) {
-	Elf32_Sym *target = NULL;
+/**
+ * 虚拟地址转换成文件偏移, extent返回所在PT_LOAD在文件中剩余的字节数
+ */
+template<class T>
+static off_t vaddrToOffset(ElfInfoT<T> &info, typename T::Addr vaddr, size_t *extent){
+	for(int i=0; i<info.phnum; i++){
+		typename T::Phdr &phdr = info.phdr[i];
 
-	unsigned hash = elf_hash(symbol);
-	uint32_t index = info.bucket[hash % info.nbucket];
+		if(phdr.p_type == PT_LOAD && vaddr >= phdr.p_vaddr && vaddr < phdr.p_vaddr + phdr.p_filesz){
+			SAFE_SET_VALUE(extent, phdr.p_vaddr + phdr.p_filesz - vaddr);
+			return vaddr - phdr.p_vaddr + phdr.p_offset;
+		}
+	}
+
+	return -1;
+}
+
+template<class T, class D>
+static bool mapDynRegion(ElfInfoT<T> &info, ElfHandle *handle, typename T::Addr vaddr, size_t size, int advice, D *data){
+	size_t extent = 0;
+	off_t offset = vaddrToOffset(info, vaddr, &extent);
+
+	if(offset < 0 || size > extent){
+		LOGE("[-] 0x%lx is not in the file image\n", (unsigned long)vaddr);
+		return false;
+	}
+
+	*data = reinterpret_cast<D>(const_cast<void *>(mapElfFile(handle, offset, size, advice)));
+	return *data != NULL;
+}
+
+template<class T>
+bool getElfInfoByFileView(ElfInfoT<T> &info, ElfHandle *handle){
+	typedef typename T::Ehdr Ehdr;
+	typedef typename T::Phdr Phdr;
+	typedef typename T::Dyn Dyn;
+	typedef typename T::Addr Addr;
+
+	memset(&info, 0, sizeof(info));
+	info.handle = handle;
+	info.elf_base = NULL;
+
+	info.ehdr = reinterpret_cast<Ehdr *>(readElfFile(handle, 0, sizeof(Ehdr)));
+	if(!info.ehdr || memcmp(info.ehdr->e_ident, ELFMAG, SELFMAG)
+			|| info.ehdr->e_ident[EI_CLASS] != T::ELFCLASS || info.ehdr->e_machine != T::MACHINE){
+		LOGE("[-] not an elf of the expected class and machine\n");
+		return false;
+	}
+
+	info.phnum = info.ehdr->e_phnum;
+	info.phdr = reinterpret_cast<Phdr *>(readElfFile(handle, info.ehdr->e_phoff, sizeof(Phdr) * info.phnum));
+	if(!info.phdr){
+		return false;
+	}
+
+	// section headers are not needed, and may be stripped anyway
+	info.shdr = NULL;
+	info.shstr = NULL;
+
+	Phdr *dynamic = findSegmentByType(info, PT_DYNAMIC);
+	if(!dynamic){
+		LOGE("[-] could't find PT_DYNAMIC segment");
+		return false;
+	}
+
+	info.dyn = reinterpret_cast<Dyn *>(readElfFile(handle, dynamic->p_offset, dynamic->p_filesz));
+	info.dynsz = dynamic->p_filesz / sizeof(Dyn);
+	if(!info.dyn){
+		return false;
+	}
+
+	Addr symtab = 0, strtab = 0, strsz = 0, hash = 0, gnuhash = 0;
+	Addr reldyn = 0, reldynsz = 0, relplt = 0, relpltsz = 0;
+	Addr packed = 0, packedsz = 0, relr = 0, relrsz = 0;
+	Addr versym = 0, verdef = 0, verneed = 0;
+
+	for(size_t i=0; i<info.dynsz && info.dyn[i].d_tag != DT_NULL; i++){
+		Addr value = info.dyn[i].d_un.d_val;
+
+		switch(info.dyn[i].d_tag){
+		case DT_SYMTAB: symtab = value; break;
+		case DT_STRTAB: strtab = value; break;
+		case DT_STRSZ: strsz = value; break;
+		case DT_HASH: hash = value; break;
+		case DT_GNU_HASH: gnuhash = value; break;
+		case T::DT_RELTAB: reldyn = value; break;
+		case T::DT_RELTABSZ: reldynsz = value; break;
+		case DT_JMPREL: relplt = value; break;
+		case DT_PLTRELSZ: relpltsz = value; break;
+		case DT_ANDROID_REL: case DT_ANDROID_RELA: packed = value; break;
+		case DT_ANDROID_RELSZ: case DT_ANDROID_RELASZ: packedsz = value; break;
+		case DT_RELR: case DT_ANDROID_RELR: relr = value; break;
+		case DT_RELRSZ: case DT_ANDROID_RELRSZ: relrsz = value; break;
+		case DT_VERSYM: versym = value; break;
+		case DT_VERDEF: verdef = value; break;
+		case DT_VERDEFNUM: info.verdefnum = value; break;
+		case DT_VERNEED: verneed = value; break;
+		case DT_VERNEEDNUM: info.verneednum = value; break;
+		}
+	}
+
+	// names are compared on every lookup, hash tables and symbols are probed at random
+	if(!strtab || !mapDynRegion(info, handle, strtab, strsz, MADV_WILLNEED, &info.symstr)){
+		return false;
+	}
+
+	if(hash){
+		uint32_t *header = reinterpret_cast<uint32_t *>(readElfFile(handle, vaddrToOffset(info, hash, NULL), sizeof(uint32_t) * 2));
+		if(!header || !mapDynRegion(info, handle, hash, sizeof(uint32_t) * (2 + header[0] + header[1]), MADV_WILLNEED, &info.bucket)){
+			return false;
+		}
+
+		info.nbucket = header[0];
+		info.nchain = header[1];
+		info.bucket += 2;
+		info.chain = info.bucket + info.nbucket;
+		info.symsz = info.nchain;
+	}
+
+	if(gnuhash){
+		// the chain length is only known after walking it, map up to the end of the segment
+		size_t extent = 0;
+		uint32_t *rawdata = NULL;
+		if(vaddrToOffset(info, gnuhash, &extent) < 0 || !mapDynRegion(info, handle, gnuhash, extent, MADV_RANDOM, &rawdata)){
+			return false;
+		}
+		setGnuHashInfo(info, rawdata);
+	}
+
+	if(!symtab || !info.symsz || !mapDynRegion(info, handle, symtab, sizeof(typename T::Sym) * info.symsz, MADV_RANDOM, &info.sym)){
+		return false;
+	}
+
+	// version tables are small and chained by offsets, map up to the end of the segment
+	size_t extent = 0;
+	if(versym && !mapDynRegion(info, handle, versym, sizeof(typename T::Versym) * info.symsz, MADV_RANDOM, &info.versym)){
+		return false;
+	}
+
+	if(verdef && vaddrToOffset(info, verdef, &extent) >= 0){
+		mapDynRegion(info, handle, verdef, extent, MADV_WILLNEED, &info.verdef);
+	}
+
+	if(verneed && vaddrToOffset(info, verneed, &extent) >= 0){
+		mapDynRegion(info, handle, verneed, extent, MADV_WILLNEED, &info.verneed);
+	}
+
+	// relocations are walked once from start to end
+	if(reldynsz && mapDynRegion(info, handle, reldyn, reldynsz, MADV_SEQUENTIAL, &info.reldyn)){
+		info.reldynsz = reldynsz / sizeof(typename T::Rel);
+	}
+
+	if(relpltsz && mapDynRegion(info, handle, relplt, relpltsz, MADV_SEQUENTIAL, &info.relplt)){
+		info.relpltsz = relpltsz / sizeof(typename T::Rel);
+	}
+
+	if(packedsz && mapDynRegion(info, handle, packed, packedsz, MADV_SEQUENTIAL, &info.packed_rel)){
+		info.packed_relsz = packedsz;
+	}
 
-	if (!strcmp(info.symstr + info.sym[index].st_name, symbol)) {
-		target = info.sym + index;
+	if(relrsz && mapDynRegion(info, handle, relr, relrsz, MADV_SEQUENTIAL, &info.relr)){
+		info.relrsz = relrsz / sizeof(Addr);
 	}
 
-	if (!target) {
-		do {
-			index = info.chain[index];
-			if (!strcmp(info.symstr + info.sym[index].st_name, symbol)) {
-				target = info.sym + index;
+	for(int i=0; i<info.phnum && !info.build_id; i++){
+		Phdr &phdr = info.phdr[i];
+		if(phdr.p_type == PT_NOTE){
+			uint8_t *notes = reinterpret_cast<uint8_t *>(readElfFile(handle, phdr.p_offset, phdr.p_filesz));
+			if(notes){
+				setBuildId(info, notes, phdr.p_filesz, phdr.p_align);
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * 查找前把版本名解析成版本索引, 链上只比较versym中的整数
+ */
+struct ElfVersionMatch {
+	const char *version;
+
+	// 0xffff never matches a masked versym
+	uint16_t def_ndx;
+	uint16_t need_ndx;
+};
+
+enum {
+	VERSION_NONE = 0,
+	VERSION_FALLBACK = 1,
+	VERSION_MATCH = 2
+};
+
+template<class T>
+static void resolveVersion(ElfInfoT<T> &info, const char *version, ElfVersionMatch &vm){
+	vm.version = version;
+	vm.def_ndx = 0xffff;
+	vm.need_ndx = 0xffff;
+
+	if(!version || !info.versym){
+		return;
+	}
+
+	unsigned hash = elf_hash(version);
+
+	uint8_t *def = reinterpret_cast<uint8_t *>(info.verdef);
+	for(size_t i=0; def && i<info.verdefnum; i++){
+		typename T::Verdef *verdef = reinterpret_cast<typename T::Verdef *>(def);
+		typename T::Verdaux *aux = reinterpret_cast<typename T::Verdaux *>(def + verdef->vd_aux);
+
+		// the first aux is the name of the version itself
+		if(verdef->vd_hash == hash && !strcmp(info.symstr + aux->vda_name, version)){
+			vm.def_ndx = verdef->vd_ndx & ~VERSYM_HIDDEN;
+			break;
+		}
+
+		if(!verdef->vd_next){
+			break;
+		}
+		def += verdef->vd_next;
+	}
+
+	uint8_t *need = reinterpret_cast<uint8_t *>(info.verneed);
+	for(size_t i=0; need && i<info.verneednum && vm.need_ndx == 0xffff; i++){
+		typename T::Verneed *verneed = reinterpret_cast<typename T::Verneed *>(need);
+
+		uint8_t *next = need + verneed->vn_aux;
+		for(int j=0; j<verneed->vn_cnt; j++){
+			typename T::Vernaux *aux = reinterpret_cast<typename T::Vernaux *>(next);
+			if(aux->vna_hash == hash && !strcmp(info.symstr + aux->vna_name, version)){
+				vm.need_ndx = aux->vna_other & ~VERSYM_HIDDEN;
 				break;
 			}
 
-		} while (index != 0);
+			if(!aux->vna_next){
+				break;
+			}
+			next += aux->vna_next;
+		}
+
+		if(!verneed->vn_next){
+			break;
+		}
+		need += verneed->vn_next;
+	}
+}
+
+/**
+ * 不指定版本时和链接器一样优先默认版本, 隐藏的旧版本只作为候选
+ */
+template<class T>
+static inline int matchVersion(ElfInfoT<T> &info, const ElfVersionMatch &vm, uint32_t index){
+	if(!info.versym){
+		return vm.version ? VERSION_NONE : VERSION_MATCH;
+	}
+
+	uint16_t versym = info.versym[index];
+	if(!vm.version){
+		return (versym & VERSYM_HIDDEN) ? VERSION_FALLBACK : VERSION_MATCH;
+	}
+
+	versym &= ~VERSYM_HIDDEN;
+	return versym == vm.def_ndx || versym == vm.need_ndx ? VERSION_MATCH : VERSION_NONE;
+}
+
+/**
+ * .gnu.hash只包含已定义符号, bloom过滤器可以用几条指令排除大部分不存在的符号
+ */
+template<class T>
+static int gnuLookup(ElfInfoT<T> &info, const char *symbol, const ElfVersionMatch &vm){
+	typedef typename T::Addr Addr;
+	const uint32_t bits = sizeof(Addr) * 8;
+
+	uint32_t hash = gnu_hash(symbol);
+	Addr word = info.gnu_bloom[(hash / bits) & (info.gnu_maskwords - 1)];
+	Addr mask = ((Addr)1 << (hash % bits)) | ((Addr)1 << ((hash >> info.gnu_shift2) % bits));
+
+	if((word & mask) != mask){
+		return -1;
+	}
+
+	uint32_t index = info.gnu_bucket[hash % info.gnu_nbucket];
+	if(index < info.gnu_symoffset){
+		return -1;
+	}
+
+	int fallback = -1;
+	for(;;){
+		uint32_t chainhash = info.gnu_chain[index];
+
+		if((hash | 1) == (chainhash | 1) && !strcmp(info.symstr + info.sym[index].st_name, symbol)){
+			int match = matchVersion(info, vm, index);
+			if(match == VERSION_MATCH){
+				return index;
+			}else if(match == VERSION_FALLBACK && fallback < 0){
+				fallback = index;
+			}
+		}
+
+		if(chainhash & 1){
+			break;
+		}
+		index++;
+	}
+
+	return fallback;
+}
+
+template<class T>
+void buildUndefIndex(ElfInfoT<T> &info){
+	if(!info.gnu_bucket || info.undef_index || info.gnu_symoffset <= 1){
+		return;
+	}
+
+	// at most half full
+	uint32_t size = 4;
+	while(size < info.gnu_symoffset * 2){
+		size <<= 1;
+	}
+
+	uint32_t *table = (uint32_t *) calloc(size, sizeof(uint32_t));
+	for(uint32_t index = 1; index < info.gnu_symoffset; index++){
+		uint32_t slot = gnu_hash(info.symstr + info.sym[index].st_name) & (size - 1);
+		while(table[slot]){
+			slot = (slot + 1) & (size - 1);
+		}
+		table[slot] = index;
+	}
+
+	info.undef_mask = size - 1;
+	info.undef_index = table;
+}
+
+/**
+ * 导入符号不在.gnu.hash中, 它们位于[1, symoffset), 有undef_index时只探测同hash的几个位置
+ * 同名的多个版本返回下标最小的一个, 与线性查找一致
+ */
+template<class T>
+static int gnuLookupUndef(ElfInfoT<T> &info, const char *symbol, const ElfVersionMatch &vm){
+	if(info.undef_index){
+		int found = -1;
+		for(uint32_t slot = gnu_hash(symbol) & info.undef_mask; info.undef_index[slot]; slot = (slot + 1) & info.undef_mask){
+			uint32_t index = info.undef_index[slot];
+			if((found < 0 || index < (uint32_t)found) && !strcmp(info.symstr + info.sym[index].st_name, symbol)
+					&& matchVersion(info, vm, index) != VERSION_NONE){
+				found = index;
+			}
+		}
+		return found;
+	}
+
+	for(uint32_t index = 1; index < info.gnu_symoffset; index++){
+		const char *name = info.symstr + info.sym[index].st_name;
+		if(name[0] == symbol[0] && !strcmp(name, symbol) && matchVersion(info, vm, index) != VERSION_NONE){
+			return index;
+		}
+	}
+
+	return -1;
+}
+
+template<class T>
+static int sysvLookup(ElfInfoT<T> &info, const char *symbol, const ElfVersionMatch &vm){
+	if(!info.nbucket){
+		return -1;
+	}
+
+	int fallback = -1;
+	unsigned hash = elf_hash(symbol);
+	for(uint32_t index = info.bucket[hash % info.nbucket]; index != 0; index = info.chain[index]){
+		if (!strcmp(info.symstr + info.sym[index].st_name, symbol)) {
+			int match = matchVersion(info, vm, index);
+			if(match == VERSION_MATCH){
+				return index;
+			}else if(match == VERSION_FALLBACK && fallback < 0){
+				fallback = index;
+			}
+		}
+	}
+
+	return fallback;
+}
+
+template<class T>
+void findSymByName(ElfInfoT<T> &info, const char *symbol, typename T::Sym **sym, int *symidx, const char *version) {
+	int index = -1;
+
+	ElfVersionMatch vm;
+	resolveVersion(info, version, vm);
+
+	// the module does not know this version at all
+	if(version && vm.def_ndx == 0xffff && vm.need_ndx == 0xffff){
+		return;
 	}
 
-	if(target){
-		SAFE_SET_VALUE(sym, target);
+	if(info.gnu_bucket){
+		index = gnuLookup(info, symbol, vm);
+		if(index < 0){
+			index = gnuLookupUndef(info, symbol, vm);
+		}
+	}else{
+		index = sysvLookup(info, symbol, vm);
+	}
+
+	if(index > 0){
+		SAFE_SET_VALUE(sym, info.sym + index);
 		SAFE_SET_VALUE(symidx, index);
 	}
 }
 
-void printSections(ElfInfo &info){
-	Elf32_Half shnum = info.ehdr->e_shnum;
-	Elf32_Shdr *shdr = info.shdr;
+template<class T>
+const char *getSymVersion(ElfInfoT<T> &info, int symidx){
+	if(!info.versym || symidx <= 0){
+		return NULL;
+	}
+
+	uint16_t ndx = info.versym[symidx] & ~VERSYM_HIDDEN;
+	if(ndx <= 1){
+		// local or global base
+		return NULL;
+	}
+
+	uint8_t *def = reinterpret_cast<uint8_t *>(info.verdef);
+	for(size_t i=0; def && i<info.verdefnum; i++){
+		typename T::Verdef *verdef = reinterpret_cast<typename T::Verdef *>(def);
+		if(verdef->vd_ndx == ndx){
+			typename T::Verdaux *aux = reinterpret_cast<typename T::Verdaux *>(def + verdef->vd_aux);
+			return info.symstr + aux->vda_name;
+		}
+
+		if(!verdef->vd_next){
+			break;
+		}
+		def += verdef->vd_next;
+	}
+
+	uint8_t *need = reinterpret_cast<uint8_t *>(info.verneed);
+	for(size_t i=0; need && i<info.verneednum; i++){
+		typename T::Verneed *verneed = reinterpret_cast<typename T::Verneed *>(need);
+
+		uint8_t *next = need + verneed->vn_aux;
+		for(int j=0; j<verneed->vn_cnt; j++){
+			typename T::Vernaux *aux = reinterpret_cast<typename T::Vernaux *>(next);
+			if((aux->vna_other & ~VERSYM_HIDDEN) == ndx){
+				return info.symstr + aux->vna_name;
+			}
+
+			if(!aux->vna_next){
+				break;
+			}
+			next += aux->vna_next;
+		}
+
+		if(!verneed->vn_next){
+			break;
+		}
+		need += verneed->vn_next;
+	}
+
+	return NULL;
+}
+
+template<class T>
+void printSections(ElfInfoT<T> &info){
+	typename T::Half shnum = info.ehdr->e_shnum;
+	typename T::Shdr *shdr = info.shdr;
 
 	LOGI("Sections: \n");
 	for(int i=0; i<shnum; i++, shdr++){
 		const char *name = shdr->sh_name == 0 || !info.shstr ? "UNKOWN" :  (const char *)(shdr->sh_name + info.shstr);
-		LOGI("[%.2d] %-20s 0x%.8x\n", i, name, shdr->sh_addr);
+		LOGI("[%.2d] %-20s 0x%.8lx\n", i, name, (unsigned long)shdr->sh_addr);
 	}
 }
 
-void printSegments(ElfInfo &info){
-	Elf32_Phdr *phdr = info.phdr;
-	Elf32_Half phnum = info.ehdr->e_phnum;
+template<class T>
+void printSegments(ElfInfoT<T> &info){
+	typename T::Phdr *phdr = info.phdr;
+	typename T::Half phnum = info.phnum;
 
 	LOGI("Segments: \n");
 	for(int i=0; i<phnum; i++){
-		LOGI("[%.2d] %-20d 0x%-.8x 0x%-.8x %-8d %-8d\n", i,
-				phdr[i].p_type, phdr[i].p_vaddr,
-				phdr[i].p_paddr, phdr[i].p_filesz,
-				phdr[i].p_memsz);
+		LOGI("[%.2d] %-20d 0x%-.8lx 0x%-.8lx %-8lu %-8lu\n", i,
+				phdr[i].p_type, (unsigned long)phdr[i].p_vaddr,
+				(unsigned long)phdr[i].p_paddr, (unsigned long)phdr[i].p_filesz,
+				(unsigned long)phdr[i].p_memsz);
 	}
 }
 
-void printfDynamics(ElfInfo &info){
-	Elf32_Dyn *dyn = info.dyn;
+template<class T>
+void printfDynamics(ElfInfoT<T> &info){
+	typename T::Dyn *dyn = info.dyn;
 
 	LOGI(".dynamic section info:\n");
 	const char *type = NULL;
 
-	for(int i=0; i<info.dynsz; i++){
+	for(size_t i=0; i<info.dynsz; i++){
 		switch(dyn[i].d_tag){
 		case DT_INIT:
 			type = "DT_INIT";
@@ -272,12 +888,18 @@ void printfDynamics(ElfInfo &info){
 		case DT_REL:
 			type = "DT_REL";
 			break;
+		case DT_RELA:
+			type = "DT_RELA";
+			break;
 		case DT_SONAME:
 			type = "DT_SONAME";
 			break;
 		case DT_HASH:
 			type = "DT_HASH";
 			break;
+		case DT_GNU_HASH:
+			type = "DT_GNU_HASH";
+			break;
 		default:
 			type = NULL;
 			break;
@@ -285,7 +907,7 @@ void printfDynamics(ElfInfo &info){
 
 		// we only printf that we need.
 		if(type){
-			LOGI("[%.2d] %-10s 0x%-.8x 0x%-.8x\n", i, type,  dyn[i].d_tag, dyn[i].d_un.d_val);
+			LOGI("[%.2d] %-10s 0x%-.8lx 0x%-.8lx\n", i, type, (unsigned long)dyn[i].d_tag, (unsigned long)dyn[i].d_un.d_val);
 		}
 
 		if(dyn[i].d_tag == DT_NULL){
@@ -294,31 +916,69 @@ void printfDynamics(ElfInfo &info){
 	}
 }
 
-void printfSymbols(ElfInfo &info){
-	Elf32_Sym *sym = info.sym;
+template<class T>
+void printfSymbols(ElfInfoT<T> &info){
+	typename T::Sym *sym = info.sym;
 
 	LOGI("dynsym section info:\n");
-	for(int i=0; i<info.symsz; i++){
-		LOGI("[%2d] %-20s\n", i, sym[i].st_name + info.symstr);
+	for(size_t i=0; i<info.symsz; i++){
+		LOGI("[%2d] %-20s\n", (int)i, sym[i].st_name + info.symstr);
 	}
 }
 
 
-void printfRelInfo(ElfInfo &info){
-	Elf32_Rel* rels[] = {info.reldyn, info.relplt};
-	Elf32_Word resszs[] = {info.reldynsz, info.relpltsz};
+template<class T>
+void printfRelInfo(ElfInfoT<T> &info){
+	typename T::Rel* rels[] = {info.reldyn, info.relplt};
+	typename T::Word resszs[] = {info.reldynsz, info.relpltsz};
 
-	Elf32_Sym *sym = info.sym;
+	typename T::Sym *sym = info.sym;
 
 	LOGI("rel section info:\n");
-	for(int i=0; i<sizeof(rels)/sizeof(rels[0]); i++){
-		Elf32_Rel *rel = rels[i];
-		Elf32_Word relsz = resszs[i];
+	for(size_t i=0; i<sizeof(rels)/sizeof(rels[0]); i++){
+		typename T::Rel *rel = rels[i];
+		typename T::Word relsz = resszs[i];
+
+		for(size_t j=0; j<relsz; j++){
+		const char *name = sym[T::rSym(rel[j].r_info)].st_name + info.symstr;
+		LOGI("[%.2d-%.4d] 0x%-.8lx 0x%-.8lx %-10s\n", (int)i, (int)j, (unsigned long)rel[j].r_offset, (unsigned long)rel[j].r_info, name);
+		}
+	}
+
+	if(info.packed_rel){
+		PackedRelIterator<T> it(info.packed_rel, info.packed_relsz);
+		typename T::Rel rel;
+
+		for(int j=0; it.next(rel); j++){
+		const char *name = sym[T::rSym(rel.r_info)].st_name + info.symstr;
+		LOGI("[ap-%.4d] 0x%-.8lx 0x%-.8lx %-10s\n", j, (unsigned long)rel.r_offset, (unsigned long)rel.r_info, name);
+		}
+	}
+
+	if(info.relr){
+		RelrIterator<T> it(info.relr, info.relrsz);
+		typename T::Addr offset;
 
-		for(int j=0; j<relsz; j++){
-		const char *name = sym[ELF32_R_SYM(rel[j].r_info)].st_name + info.symstr;
-		LOGI("[%.2d-%.4d] 0x%-.8x 0x%-.8x %-10s\n", i, j, rel[j].r_offset, rel[j].r_info, name);
+		for(int j=0; it.next(offset); j++){
+		LOGI("[rr-%.4d] 0x%-.8lx\n", j, (unsigned long)offset);
 		}
 	}
 }
 
+#define INSTANTIATE_ELF_UTILS(T) \
+	template void getElfInfoBySectionView<T>(ElfInfoT<T> &, const ElfHandle *); \
+	template void getElfInfoBySegmentView<T>(ElfInfoT<T> &, const ElfHandle *); \
+	template bool getElfInfoByFileView<T>(ElfInfoT<T> &, ElfHandle *); \
+	template void findSymByName<T>(ElfInfoT<T> &, const char *, T::Sym **, int *, const char *); \
+	template void buildUndefIndex<T>(ElfInfoT<T> &); \
+	template const char *getSymVersion<T>(ElfInfoT<T> &, int); \
+	template void printSections<T>(ElfInfoT<T> &); \
+	template void printSegments<T>(ElfInfoT<T> &); \
+	template void printfDynamics<T>(ElfInfoT<T> &); \
+	template void printfSymbols<T>(ElfInfoT<T> &); \
+	template void printfRelInfo<T>(ElfInfoT<T> &);
+
+INSTANTIATE_ELF_UTILS(ElfArm)
+INSTANTIATE_ELF_UTILS(ElfArm64)
+INSTANTIATE_ELF_UTILS(ElfX86)
+INSTANTIATE_ELF_UTILS(ElfX86_64)
@@ -13,29 +13,52 @@
 #include <stddef.h>
 
 #include "elfio.h"
+#include "elftraits.h"
+#include "elfreloc.h"
 
 /**
- * elf关键信息
+ * elf关键信息, T为ElfArchTraits
  */
-struct ElfInfo{
+template<class T>
+struct ElfInfoT{
+	typedef T Traits;
+	typedef typename T::Ehdr Ehdr;
+	typedef typename T::Phdr Phdr;
+	typedef typename T::Shdr Shdr;
+	typedef typename T::Dyn Dyn;
+	typedef typename T::Sym Sym;
+	typedef typename T::Rel Rel;
+	typedef typename T::Word Word;
+	typedef typename T::Addr Addr;
+
 	const ElfHandle *handle;
 
 	uint8_t *elf_base;
 
-	Elf32_Ehdr *ehdr;
-	Elf32_Phdr *phdr;
-	Elf32_Shdr *shdr;
+	Ehdr *ehdr;
+	Phdr *phdr;
+	Shdr *shdr;
+
+	typename T::Half phnum;
+
+	Dyn *dyn;
+	Word dynsz;
 
-	Elf32_Dyn *dyn;
-	Elf32_Word dynsz;
+	Sym *sym;
+	Word symsz;
 
-	Elf32_Sym *sym;
-	Elf32_Word symsz;
+	Rel *relplt;
+	Word relpltsz;
+	Rel *reldyn;
+	Word reldynsz;
 
-	Elf32_Rel *relplt;
-	Elf32_Word relpltsz;
-	Elf32_Rel *reldyn;
-	Elf32_Word reldynsz;
+	// DT_ANDROID_REL(A), APS2 packed .rel.dyn
+	uint8_t *packed_rel;
+	size_t packed_relsz;
+
+	// DT_RELR, relative relocations only
+	Addr *relr;
+	Word relrsz;
 
 	uint32_t nbucket;
 	uint32_t nchain;
@@ -43,56 +66,122 @@ struct ElfInfo{
 	uint32_t *bucket;
 	uint32_t *chain;
 
+	// DT_GNU_HASH
+	uint32_t gnu_nbucket;
+	uint32_t gnu_symoffset;
+	uint32_t gnu_maskwords;
+	uint32_t gnu_shift2;
+
+	Addr *gnu_bloom;
+	uint32_t *gnu_bucket;
+	uint32_t *gnu_chain;
+
+	// hash table of the imports in [1, gnu_symoffset), symbol indexes, 0 is empty
+	// NULL until buildUndefIndex, the imports are then scanned linearly
+	uint32_t *undef_index;
+	uint32_t undef_mask;
+
 	const char *shstr;
 	const char *symstr;
+
+	// DT_VERSYM/DT_VERDEF/DT_VERNEED, versym is NULL if the module is not versioned
+	typename T::Versym *versym;
+	typename T::Verdef *verdef;
+	Word verdefnum;
+	typename T::Verneed *verneed;
+	Word verneednum;
+
+	// NT_GNU_BUILD_ID from PT_NOTE, NULL if absent
+	const uint8_t *build_id;
+	size_t build_idsz;
 };
 
+/**
+ * 当前进程架构的elf信息
+ */
+typedef ElfInfoT<ElfNative> ElfInfo;
+typedef ElfNative::Sym ElfSym;
+typedef ElfNative::Rel ElfRel;
+
 /**
  * 符号hash函数
  */
 unsigned elf_hash(const char *name);
 
+/**
+ * gnu符号hash函数
+ */
+uint32_t gnu_hash(const char *name);
+
 /**
  * 从section视图获取info
  */
-void getElfInfoBySectionView(ElfInfo &info, const ElfHandle *handle);
+template<class T>
+void getElfInfoBySectionView(ElfInfoT<T> &info, const ElfHandle *handle);
 
 /**
  * 从segment视图获取info
  */
-void getElfInfoBySegmentView(ElfInfo &info, const ElfHandle *handle);
+template<class T>
+void getElfInfoBySegmentView(ElfInfoT<T> &info, const ElfHandle *handle);
+
+/**
+ * 从openElfByFileLazy打开的文件获取info, 只读取和映射用到的区域, 类别或架构不匹配时返回false
+ */
+template<class T>
+bool getElfInfoByFileView(ElfInfoT<T> &info, ElfHandle *handle);
 
 
 /**
- * 根据符号名寻找Sym
+ * 根据符号名寻找Sym, 优先使用DT_GNU_HASH, 没有时才使用DT_HASH
+ * version为NULL时和链接器一样选择默认版本, 否则只匹配该版本(如GLIBC_2.14)
+ */
+template<class T>
+void findSymByName(ElfInfoT<T> &info, const char *symbol, typename T::Sym **sym, int *symidx, const char *version = NULL);
+
+/**
+ * 为DT_GNU_HASH之外的导入符号建立hash表, 之后findSymByName查找它们不再线性遍历
+ * 没有DT_GNU_HASH时什么也不做, 表用free释放
+ */
+template<class T>
+void buildUndefIndex(ElfInfoT<T> &info);
+
+/**
+ * 获取符号的版本名, 没有版本时返回NULL
  */
-void findSymByName(ElfInfo &info, const char *symbol, Elf32_Sym **sym, int *symidx);
+template<class T>
+const char *getSymVersion(ElfInfoT<T> &info, int symidx);
 
 /**
  * 打印section信息
  */
-void printSections(ElfInfo &info);
+template<class T>
+void printSections(ElfInfoT<T> &info);
 
 
 /**
  * 打印segment信息
  */
-void printSegments(ElfInfo &info);
+template<class T>
+void printSegments(ElfInfoT<T> &info);
 
 /**
  * 打印dynamic信息
  */
-void printfDynamics(ElfInfo &info);
+template<class T>
+void printfDynamics(ElfInfoT<T> &info);
 
 /**
  * 打印所有符号信息
  */
-void printfSymbols(ElfInfo &info);
+template<class T>
+void printfSymbols(ElfInfoT<T> &info);
 
 /**
  * 打印重定位信息
  */
-void printfRelInfo(ElfInfo &info);
+template<class T>
+void printfRelInfo(ElfInfoT<T> &info);
 
 
 #endif /* ELFUTILS_H_ */
@@ -0,0 +1,287 @@
+/*
+ * arm64insn.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <string.h>
+
+#include "arm64insn.h"
+
+// x17 (ip1) may be clobbered by veneers, the hook uses it the same way
+#define SCRATCH 17
+
+#define MAX_RELOCATED 24
+
+static inline bool fitsSigned(int64_t value, int bits){
+	return value >= -((int64_t)1 << (bits - 1)) && value < ((int64_t)1 << (bits - 1));
+}
+
+static inline int64_t signExtend(uint64_t value, int bits){
+	return (int64_t)(value << (64 - bits)) >> (64 - bits);
+}
+
+// instructions are always little endian, whatever the data endianness is
+static inline uint32_t readInsn(const uint8_t *code){
+	return code[0] | (code[1] << 8) | (code[2] << 16) | ((uint32_t)code[3] << 24);
+}
+
+static inline void emit(uint8_t *dst, size_t *out, uint32_t insn){
+	uint8_t *p = dst + *out;
+	p[0] = insn;
+	p[1] = insn >> 8;
+	p[2] = insn >> 16;
+	p[3] = insn >> 24;
+	*out += 4;
+}
+
+static inline void emit64(uint8_t *dst, size_t *out, uint64_t value){
+	emit(dst, out, (uint32_t)value);
+	emit(dst, out, (uint32_t)(value >> 32));
+}
+
+static inline uint32_t encodeLdrLiteral(int rt, int64_t offset){
+	return 0x58000000 | ((uint32_t)(offset >> 2) & 0x7ffff) << 5 | rt;
+}
+
+static inline uint32_t encodeB(int64_t offset){
+	return 0x14000000 | ((uint32_t)(offset >> 2) & 0x3ffffff);
+}
+
+/**
+ * ldr xd, #8; b #12; .quad value
+ */
+static void emitLoadConst(uint8_t *dst, size_t *out, int rd, uint64_t value){
+	emit(dst, out, encodeLdrLiteral(rd, 8));
+	emit(dst, out, encodeB(12));
+	emit64(dst, out, value);
+}
+
+int writeArm64Jump(uint8_t *dst, uint64_t pc, uint64_t target){
+	size_t out = 0;
+	int64_t offset = (int64_t)(target - pc);
+
+	if(fitsSigned(offset, 28)){
+		emit(dst, &out, encodeB(offset));
+		return out;
+	}
+
+	// ldr x17, #8; br x17; .quad target
+	emit(dst, &out, encodeLdrLiteral(SCRATCH, 8));
+	emit(dst, &out, 0xd61f0000 | SCRATCH << 5);
+	emit64(dst, &out, target);
+	return out;
+}
+
+static int writeArm64Call(uint8_t *dst, uint64_t pc, uint64_t target){
+	size_t out = 0;
+	int64_t offset = (int64_t)(target - pc);
+
+	if(fitsSigned(offset, 28)){
+		emit(dst, &out, 0x80000000 | encodeB(offset));
+		return out;
+	}
+
+	// ldr x17, #12; blr x17; b #12; .quad target
+	emit(dst, &out, encodeLdrLiteral(SCRATCH, 12));
+	emit(dst, &out, 0xd63f0000 | SCRATCH << 5);
+	emit(dst, &out, encodeB(12));
+	emit64(dst, &out, target);
+	return out;
+}
+
+/**
+ * 条件跳转, 超出原编码范围时用反条件跳过一个绝对跳转
+ * imm19为b.cond/cbz, imm14为tbz
+ */
+static int writeArm64CondJump(uint8_t *dst, uint64_t pc, uint32_t insn, int bits, uint64_t target){
+	size_t out = 0;
+	int64_t offset = (int64_t)(target - pc);
+	uint32_t mask = ((1u << bits) - 1) << 5;
+
+	if(fitsSigned(offset, bits + 2)){
+		emit(dst, &out, (insn & ~mask) | ((uint32_t)(offset >> 2) << 5 & mask));
+		return out;
+	}
+
+	// b.cond flips bit 0 of the condition, cbz/cbnz and tbz/tbnz flip bit 24
+	uint32_t inverted = (insn & 0xff000010) == 0x54000000 ? insn ^ 1 : insn ^ 0x01000000;
+	int n = writeArm64Jump(dst + 4, pc + 4, target);
+	emit(dst, &out, (inverted & ~mask) | (uint32_t)(n / 4 + 1) << 5);
+	return out + n;
+}
+
+/**
+ * ldr (literal), 近的直接改偏移, 远的先把地址装入寄存器再读
+ */
+static int writeArm64LoadLiteral(uint8_t *dst, uint64_t pc, uint32_t insn, uint64_t addr){
+	size_t out = 0;
+	int64_t offset = (int64_t)(addr - pc);
+	int rt = insn & 0x1f;
+	int opc = insn >> 30;
+	bool simd = insn & 0x04000000;
+
+	if(fitsSigned(offset, 21)){
+		emit(dst, &out, (insn & ~(0x7ffffu << 5)) | ((uint32_t)(offset >> 2) & 0x7ffff) << 5);
+		return out;
+	}
+
+	uint32_t load;
+	if(!simd){
+		static const uint32_t loads[4] = {
+			0xb9400000,	// ldr wt, [xn]
+			0xf9400000,	// ldr xt, [xn]
+			0xb9800000,	// ldrsw xt, [xn]
+			0		// prfm, only a hint
+		};
+		load = loads[opc];
+	}else{
+		static const uint32_t loads[4] = {
+			0xbd400000,	// ldr st, [xn]
+			0xfd400000,	// ldr dt, [xn]
+			0x3dc00000,	// ldr qt, [xn]
+			0
+		};
+		load = loads[opc];
+		if(!load){
+			return -1;
+		}
+	}
+
+	if(!load){
+		return 0;
+	}
+
+	// a general register is its own base, simd loads need x17
+	int base = simd ? SCRATCH : rt;
+	emitLoadConst(dst, &out, base, addr);
+	emit(dst, &out, load | base << 5 | rt);
+	return out;
+}
+
+static int writeArm64Adr(uint8_t *dst, uint64_t pc, uint32_t insn, uint64_t target){
+	size_t out = 0;
+	int rd = insn & 0x1f;
+
+	if(insn & 0x80000000){
+		int64_t delta = (int64_t)((target >> 12) - (pc >> 12));
+		if(fitsSigned(delta, 21)){
+			uint32_t imm = (uint32_t)delta & 0x1fffff;
+			emit(dst, &out, 0x90000000 | (imm & 3) << 29 | (imm >> 2) << 5 | rd);
+			return out;
+		}
+	}else{
+		int64_t offset = (int64_t)(target - pc);
+		if(fitsSigned(offset, 21)){
+			uint32_t imm = (uint32_t)offset & 0x1fffff;
+			emit(dst, &out, 0x10000000 | (imm & 3) << 29 | (imm >> 2) << 5 | rd);
+			return out;
+		}
+	}
+
+	emitLoadConst(dst, &out, rd, target);
+	return out;
+}
+
+int relocateArm64(const uint8_t *src, uint64_t src_pc, size_t min_len, uint8_t *dst, size_t dst_size, uint64_t pc, size_t *stolen){
+	uint64_t targets[16];
+	size_t ntargets = 0;
+
+	size_t off = 0;
+	size_t out = 0;
+
+	while(off < min_len){
+		if(out + MAX_RELOCATED > dst_size){
+			return -1;
+		}
+
+		uint32_t insn = readInsn(src + off);
+		uint64_t ip = src_pc + off;
+		uint64_t npc = pc + out;
+		uint64_t target = 0;
+		bool branch = false;
+		bool end = false;
+		int n;
+
+		if((insn & 0x7c000000) == 0x14000000){
+			// b, bl
+			target = ip + signExtend(insn & 0x3ffffff, 26) * 4;
+			branch = true;
+
+			if(insn & 0x80000000){
+				n = writeArm64Call(dst + out, npc, target);
+			}else{
+				n = writeArm64Jump(dst + out, npc, target);
+				end = true;
+			}
+		}else if((insn & 0xff000010) == 0x54000000){
+			// b.cond, b.al and b.nv always branch
+			target = ip + signExtend((insn >> 5) & 0x7ffff, 19) * 4;
+			branch = true;
+
+			if((insn & 0xe) == 0xe){
+				n = writeArm64Jump(dst + out, npc, target);
+				end = true;
+			}else{
+				n = writeArm64CondJump(dst + out, npc, insn, 19, target);
+			}
+		}else if((insn & 0x7e000000) == 0x34000000){
+			// cbz, cbnz
+			target = ip + signExtend((insn >> 5) & 0x7ffff, 19) * 4;
+			branch = true;
+			n = writeArm64CondJump(dst + out, npc, insn, 19, target);
+		}else if((insn & 0x7e000000) == 0x36000000){
+			// tbz, tbnz
+			target = ip + signExtend((insn >> 5) & 0x3fff, 14) * 4;
+			branch = true;
+			n = writeArm64CondJump(dst + out, npc, insn, 14, target);
+		}else if((insn & 0x3b000000) == 0x18000000){
+			// ldr (literal), ldrsw (literal), prfm (literal)
+			target = ip + signExtend((insn >> 5) & 0x7ffff, 19) * 4;
+			n = writeArm64LoadLiteral(dst + out, npc, insn, target);
+		}else if((insn & 0x1f000000) == 0x10000000){
+			// adr, adrp
+			int64_t imm = signExtend(((insn >> 5) & 0x7ffff) << 2 | ((insn >> 29) & 3), 21);
+			target = insn & 0x80000000 ? (ip & ~(uint64_t)0xfff) + imm * 4096 : ip + imm;
+			n = writeArm64Adr(dst + out, npc, insn, target);
+		}else{
+			// br, ret, eret and the authenticated forms leave the function, blr does not
+			end = (insn & 0xfe000000) == 0xd6000000 && !(insn & 0x00200000);
+			emit(dst, &out, insn);
+			n = 0;
+		}
+
+		if(n < 0){
+			return -1;
+		}
+		out += n;
+
+		if(branch && ntargets < sizeof(targets) / sizeof(targets[0])){
+			targets[ntargets++] = target;
+		}
+
+		off += 4;
+
+		// the function ends before enough bytes could be taken
+		if(off < min_len && end){
+			return -1;
+		}
+	}
+
+	// a branch back into the stolen bytes would land in the middle of the patch
+	for(size_t i = 0; i < ntargets; i++){
+		if(targets[i] >= src_pc && targets[i] < src_pc + off){
+			return -1;
+		}
+	}
+
+	if(out + 16 > dst_size){
+		return -1;
+	}
+
+	out += writeArm64Jump(dst + out, pc + out, src_pc + off);
+
+	*stolen = off;
+	return out;
+}
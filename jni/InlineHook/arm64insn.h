@@ -0,0 +1,26 @@
+/*
+ * arm64insn.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ARM64INSN_H_
+#define ARM64INSN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * 把src开始至少min_len字节的AArch64指令重定位到dst, src原本位于src_pc, dst运行时位于pc
+ * 只读写字节缓冲区, 不依赖当前进程的架构, x17作为临时寄存器
+ * stolen返回拿走的原指令字节数, 返回写入dst的字节数, 失败返回-1
+ */
+int relocateArm64(const uint8_t *src, uint64_t src_pc, size_t min_len, uint8_t *dst, size_t dst_size, uint64_t pc, size_t *stolen);
+
+/**
+ * 在dst写入跳到target的指令, 距离在±128MB以内时4字节, 否则16字节, 返回写入的字节数
+ */
+int writeArm64Jump(uint8_t *dst, uint64_t pc, uint64_t target);
+
+#endif /* ARM64INSN_H_ */
@@ -0,0 +1,293 @@
+/*
+ * inlinehook.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "inlinehook.h"
+#include "x64insn.h"
+
+#if defined(__x86_64__)
+
+// relocated prologue and the jump back, then a relay to the replacement if it is too far
+#define TRAMPOLINE_SIZE 128
+#define RELAY_OFFSET 112
+
+#define TRAMPOLINE_PAGE_SIZE 0x4000
+
+// a little less than 2GB, anything in range can be reached by a rel32
+#define NEAR_RANGE 0x7ff00000UL
+
+/**
+ * 离被hook函数不超过2GB的可执行内存, 只分配不释放
+ */
+struct TrampolinePage {
+	TrampolinePage *next;
+	uint8_t *base;
+	size_t used;
+};
+
+/**
+ * 一个已安装的inline hook
+ */
+struct InlineHookEntry {
+	InlineHookEntry *next;
+
+	uint8_t *target;
+	void *replace_func;
+	uint8_t *trampoline;
+
+	// the original bytes under the patch
+	uint8_t backup[8];
+	size_t patchsz;
+};
+
+static TrampolinePage *pages = NULL;
+static InlineHookEntry *hooks = NULL;
+static pthread_mutex_t inline_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline bool isNear(uintptr_t a, uintptr_t b){
+	return (a > b ? a - b : b - a) < NEAR_RANGE;
+}
+
+/**
+ * 以target为中心向两边尝试, 直到内核给出一块rel32可达的内存
+ */
+static uint8_t *mapNearPage(uintptr_t target){
+	const uintptr_t step = 0x1000000;
+	uintptr_t pagemask = ~((uintptr_t)getpagesize() - 1);
+
+	for(uintptr_t delta = step; delta < NEAR_RANGE; delta += step){
+		for(int dir = 0; dir < 2; dir++){
+			if(!dir && target < delta){
+				continue;
+			}
+
+			uintptr_t hint = (dir ? target + delta : target - delta) & pagemask;
+			void *addr = mmap((void *)hint, TRAMPOLINE_PAGE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(addr == MAP_FAILED){
+				continue;
+			}
+
+			if(isNear((uintptr_t)addr, target) && isNear((uintptr_t)addr + TRAMPOLINE_PAGE_SIZE, target)){
+				return (uint8_t *)addr;
+			}
+			munmap(addr, TRAMPOLINE_PAGE_SIZE);
+		}
+	}
+
+	return NULL;
+}
+
+static uint8_t *allocTrampoline(uintptr_t target){
+	for(TrampolinePage *page = pages; page; page = page->next){
+		if(page->used + TRAMPOLINE_SIZE <= TRAMPOLINE_PAGE_SIZE && isNear((uintptr_t)page->base, target)
+				&& isNear((uintptr_t)page->base + TRAMPOLINE_PAGE_SIZE, target)){
+			uint8_t *trampoline = page->base + page->used;
+			page->used += TRAMPOLINE_SIZE;
+			return trampoline;
+		}
+	}
+
+	uint8_t *base = mapNearPage(target);
+	if(!base){
+		return NULL;
+	}
+
+	TrampolinePage *page = (TrampolinePage *) malloc(sizeof(TrampolinePage));
+	page->base = base;
+	page->used = TRAMPOLINE_SIZE;
+	page->next = pages;
+	pages = page;
+
+	return base;
+}
+
+/**
+ * 归还一个还没有用过的trampoline, 调用者持有inline_lock, 它总是所在页最后分配的一个
+ */
+static void releaseTrampoline(uint8_t *trampoline){
+	for(TrampolinePage *page = pages; page; page = page->next){
+		if(page->base + page->used == trampoline + TRAMPOLINE_SIZE){
+			page->used -= TRAMPOLINE_SIZE;
+			return;
+		}
+	}
+}
+
+/**
+ * 在addr所在的对齐8字节字中一次写入n字节, 调用者保证不跨字
+ */
+static inline void storeCodeWord(uint8_t *addr, const uint8_t *bytes, size_t n){
+	uintptr_t word = (uintptr_t)addr & ~(uintptr_t)7;
+	uint64_t value = __atomic_load_n((uint64_t *)word, __ATOMIC_RELAXED);
+	memcpy((uint8_t *)&value + ((uintptr_t)addr - word), bytes, n);
+	__atomic_store_n((uint64_t *)word, value, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * 写入不超过8字节的代码, 在同一个8字节字内时一次原子写入,
+ * 否则先写一个跳到自身的短跳转挡住新来的线程, 写完后半部分再写开头两个字节
+ * 短跳转本身跨字时(addr % 8 == 7)无法原子写入, 返回-1
+ */
+static int writeCode(uint8_t *addr, const uint8_t *bytes, size_t n){
+	uintptr_t word = (uintptr_t)addr & ~(uintptr_t)7;
+	bool single = (uintptr_t)addr + n <= word + 8;
+	if(!single && (uintptr_t)addr + 2 > word + 8){
+		LOGE("[-] %p straddles an 8-byte word, the patch can not be written atomically.", addr);
+		return -1;
+	}
+
+	uintptr_t pagemask = ~((uintptr_t)getpagesize() - 1);
+	uintptr_t start = (uintptr_t)addr & pagemask;
+	size_t len = (((uintptr_t)addr + n - start) + getpagesize() - 1) & pagemask;
+
+	if(mprotect((void *)start, len, PROT_READ | PROT_WRITE | PROT_EXEC)){
+		LOGE("[-] mprotect %p fails.", addr);
+		return -1;
+	}
+
+	if(single){
+		storeCodeWord(addr, bytes, n);
+	}else{
+		// the two byte heads go through the aligned word, never a misaligned store
+		const uint8_t spin[2] = {0xeb, 0xfe};
+		storeCodeWord(addr, spin, 2);
+
+		memcpy(addr + 2, bytes + 2, n - 2);
+
+		storeCodeWord(addr, bytes, 2);
+	}
+
+	mprotect((void *)start, len, PROT_READ | PROT_EXEC);
+	__builtin___clear_cache((char *)addr, (char *)addr + n);
+	return 0;
+}
+
+static InlineHookEntry *findInlineHook(void *target){
+	for(InlineHookEntry *entry = hooks; entry; entry = entry->next){
+		if(entry->target == target){
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+int inlineHook(void *target, void *replace_func, void **old_func){
+	assert(target);
+	assert(replace_func);
+
+	pthread_mutex_lock(&inline_lock);
+
+	if(findInlineHook(target)){
+		pthread_mutex_unlock(&inline_lock);
+		LOGW("[-] %p had been inline hooked.", target);
+		return -1;
+	}
+
+	uint8_t *code = (uint8_t *)target;
+	uint8_t *trampoline = allocTrampoline((uintptr_t)target);
+	if(!trampoline){
+		pthread_mutex_unlock(&inline_lock);
+		LOGE("[-] no executable memory near %p.", target);
+		return -1;
+	}
+
+	size_t stolen = 0;
+	if(relocateX64(code, 5, trampoline, RELAY_OFFSET, (uintptr_t)trampoline, &stolen) < 0){
+		releaseTrampoline(trampoline);
+		pthread_mutex_unlock(&inline_lock);
+		LOGE("[-] could not relocate the prologue of %p.", target);
+		return -1;
+	}
+
+	// one jump when the replacement is in rel32 range, otherwise through the relay
+	uint8_t patch[16];
+	if(writeX64Jump(patch, (uintptr_t)target, (uintptr_t)replace_func) != 5){
+		uint8_t *relay = trampoline + RELAY_OFFSET;
+		writeX64Jump(relay, (uintptr_t)relay, (uintptr_t)replace_func);
+		writeX64Jump(patch, (uintptr_t)target, (uintptr_t)relay);
+	}
+
+	InlineHookEntry *entry = (InlineHookEntry *) calloc(1, sizeof(InlineHookEntry));
+	entry->target = code;
+	entry->replace_func = replace_func;
+	entry->trampoline = trampoline;
+	entry->patchsz = 5;
+	memcpy(entry->backup, code, entry->patchsz);
+
+	// callers may reach the replacement as soon as the patch lands
+	void *prev_func = NULL;
+	if(old_func){
+		prev_func = __atomic_exchange_n(old_func, (void *)trampoline, __ATOMIC_RELEASE);
+	}
+
+	if(writeCode(code, patch, entry->patchsz)){
+		// nothing can have reached the replacement, take everything back
+		if(old_func){
+			__atomic_store_n(old_func, prev_func, __ATOMIC_RELEASE);
+		}
+		releaseTrampoline(trampoline);
+		pthread_mutex_unlock(&inline_lock);
+		free(entry);
+		return -1;
+	}
+
+	entry->next = hooks;
+	hooks = entry;
+
+	pthread_mutex_unlock(&inline_lock);
+
+	LOGI("[+] %p was inline hooked, %d bytes relocated to %p.", target, (int)stolen, trampoline);
+	return 0;
+}
+
+int inlineUnhook(void *target){
+	pthread_mutex_lock(&inline_lock);
+
+	InlineHookEntry **link = &hooks;
+	while(*link && (*link)->target != target){
+		link = &(*link)->next;
+	}
+
+	InlineHookEntry *entry = *link;
+	if(!entry){
+		pthread_mutex_unlock(&inline_lock);
+		LOGE("[-] %p was not inline hooked.", target);
+		return -1;
+	}
+
+	int res = writeCode(entry->target, entry->backup, entry->patchsz);
+	if(!res){
+		*link = entry->next;
+		free(entry);
+	}
+
+	pthread_mutex_unlock(&inline_lock);
+	return res;
+}
+
+#else
+
+int inlineHook(void *target, void *replace_func, void **old_func){
+	LOGE("[-] inline hook is not supported on this architecture.");
+	return -1;
+}
+
+int inlineUnhook(void *target){
+	LOGE("[-] inline hook is not supported on this architecture.");
+	return -1;
+}
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * inlinehook.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef INLINEHOOK_H_
+#define INLINEHOOK_H_
+
+/**
+ * 修改target开头的指令跳转到replace_func, 可以拦截模块内部调用和通过函数指针的调用
+ * old_func返回trampoline, 调用它等于调用原函数, 目前只支持x86-64
+ * 补丁跨8字节字并且target % 8 == 7时无法原子写入, 返回-1
+ */
+int inlineHook(void *target, void *replace_func, void **old_func);
+
+/**
+ * 恢复target开头的原指令, trampoline不会释放, 其他线程可能还在其中执行
+ */
+int inlineUnhook(void *target);
+
+#endif /* INLINEHOOK_H_ */
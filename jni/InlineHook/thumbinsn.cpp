@@ -0,0 +1,489 @@
+/*
+ * thumbinsn.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <string.h>
+
+#include "thumbinsn.h"
+
+#define MAX_RELOCATED 20
+
+#define COND_AL 14
+
+/**
+ * 重定位时需要处理的指令
+ */
+enum {
+	THUMB_INSN_OTHER = 0,
+	THUMB_INSN_B,		// b, b.w, a conditional b inside an it block
+	THUMB_INSN_BCC,		// b<c>, b<c>.w
+	THUMB_INSN_CBZ,		// cbz, cbnz
+	THUMB_INSN_BL,		// bl, blx imm
+	THUMB_INSN_LDR,		// ldr/ldrb/ldrh/ldrsb/ldrsh (literal)
+	THUMB_INSN_LDRD,	// ldrd (literal)
+	THUMB_INSN_VLDR,	// vldr (literal)
+	THUMB_INSN_PLD,		// pld/pli (literal), only a hint
+	THUMB_INSN_ADR,		// adr, adr.w
+	THUMB_INSN_ADD_PC,	// add rdn, pc
+	THUMB_INSN_MOV_PC,	// mov rd, pc
+	THUMB_INSN_IT,
+	THUMB_INSN_RETURN,	// bx, pop {pc}, tbb/tbh, nothing after it belongs to the prologue
+	THUMB_INSN_BAD		// reads pc in a way that can not be moved
+};
+
+struct ThumbInsn {
+	uint8_t length;
+	uint8_t type;
+	uint8_t cond;
+	uint8_t reg;
+
+	// branch target with the thumb bit, or the literal address
+	uint32_t target;
+};
+
+static inline bool fitsSigned(int32_t value, int bits){
+	return value >= -(1 << (bits - 1)) && value < (1 << (bits - 1));
+}
+
+static inline int32_t signExtend(uint32_t value, int bits){
+	return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+static inline uint16_t readHalf(const uint8_t *code){
+	return code[0] | code[1] << 8;
+}
+
+static inline void emit16(uint8_t *dst, size_t *out, uint16_t hw){
+	dst[*out] = hw;
+	dst[*out + 1] = hw >> 8;
+	*out += 2;
+}
+
+static inline void emit32(uint8_t *dst, size_t *out, uint16_t hw1, uint16_t hw2){
+	emit16(dst, out, hw1);
+	emit16(dst, out, hw2);
+}
+
+static inline void emitWord(uint8_t *dst, size_t *out, uint32_t value){
+	emit16(dst, out, value);
+	emit16(dst, out, value >> 16);
+}
+
+/**
+ * movw rd, #lo; movt rd, #hi
+ */
+static void emitMovConst(uint8_t *dst, size_t *out, int rd, uint32_t value){
+	for(int i = 0; i < 2; i++){
+		uint32_t imm = i ? value >> 16 : value & 0xffff;
+		emit32(dst, out, (i ? 0xf2c0 : 0xf240) | ((imm >> 11) & 1) << 10 | imm >> 12,
+				((imm >> 8) & 7) << 12 | rd << 8 | (imm & 0xff));
+	}
+}
+
+/**
+ * b.w/bl, offset相对于pc + 4
+ */
+static void emitBranchW(uint8_t *dst, size_t *out, int32_t offset, uint16_t op){
+	uint32_t s = (offset >> 24) & 1;
+	uint32_t j1 = !((offset >> 23) & 1) ^ s;
+	uint32_t j2 = !((offset >> 22) & 1) ^ s;
+
+	emit32(dst, out, 0xf000 | s << 10 | ((offset >> 12) & 0x3ff), op | j1 << 13 | j2 << 11 | ((offset >> 1) & 0x7ff));
+}
+
+int writeThumbJump(uint8_t *dst, uint32_t pc, uint32_t target){
+	size_t out = 0;
+	int32_t offset = (int32_t)((target & ~1u) - (pc + 4));
+
+	if((target & 1) && fitsSigned(offset, 25)){
+		emitBranchW(dst, &out, offset, 0x9000);
+		return out;
+	}
+
+	// the literal of ldr.w pc, [pc] is read from Align(pc + 4, 4)
+	if(pc & 2){
+		emit16(dst, &out, 0xbf00);
+	}
+
+	emit32(dst, &out, 0xf8df, 0xf000);
+	emitWord(dst, &out, target);
+	return out;
+}
+
+static int writeThumbCall(uint8_t *dst, uint32_t pc, uint32_t target){
+	size_t out = 0;
+	int32_t offset = (int32_t)((target & ~1u) - (pc + 4));
+
+	if((target & 1) && fitsSigned(offset, 25)){
+		emitBranchW(dst, &out, offset, 0xd000);
+		return out;
+	}
+
+	if(pc & 2){
+		emit16(dst, &out, 0xbf00);
+	}
+
+	// adr.w lr, #9 (the thumb return address); ldr.w pc, [pc]; .word target
+	emit32(dst, &out, 0xf20f, 0x0e09);
+	emit32(dst, &out, 0xf8df, 0xf000);
+	emitWord(dst, &out, target);
+	return out;
+}
+
+/**
+ * 在dst + 2写入跳转, 再在dst写入跳过它的指令, skip为清空了偏移的b<c>或cbz/cbnz
+ */
+static int writeThumbSkip(uint8_t *dst, uint32_t pc, uint16_t skip, uint32_t target){
+	size_t out = 0;
+	int n = writeThumbJump(dst + 2, pc + 2, target);
+	int imm = n - 2;
+
+	if((skip & 0xf000) == 0xd000){
+		emit16(dst, &out, skip | imm >> 1);
+	}else{
+		emit16(dst, &out, skip | (imm >> 6) << 9 | ((imm >> 1) & 0x1f) << 3);
+	}
+
+	return out + n;
+}
+
+static int writeThumbCondJump(uint8_t *dst, uint32_t pc, int cond, uint32_t target){
+	size_t out = 0;
+	int32_t offset = (int32_t)((target & ~1u) - (pc + 4));
+
+	if(fitsSigned(offset, 21)){
+		uint32_t s = (offset >> 20) & 1;
+		uint32_t j2 = (offset >> 19) & 1;
+		uint32_t j1 = (offset >> 18) & 1;
+
+		emit32(dst, &out, 0xf000 | s << 10 | cond << 6 | ((offset >> 12) & 0x3f),
+				0x8000 | j1 << 13 | j2 << 11 | ((offset >> 1) & 0x7ff));
+		return out;
+	}
+
+	return writeThumbSkip(dst, pc, 0xd000 | (cond ^ 1) << 8, target);
+}
+
+static void decodeThumbInsn(const uint8_t *code, uint32_t ip, ThumbInsn *insn){
+	uint16_t hw1 = readHalf(code);
+	uint32_t base = (ip + 4) & ~3u;
+
+	memset(insn, 0, sizeof(ThumbInsn));
+
+	bool wide = (hw1 & 0xe000) == 0xe000 && (hw1 & 0x1800);
+	if(!wide){
+		insn->length = 2;
+
+		if((hw1 & 0xf000) == 0xd000 && ((hw1 >> 8) & 0xf) < COND_AL){
+			insn->type = THUMB_INSN_BCC;
+			insn->cond = (hw1 >> 8) & 0xf;
+			insn->target = (ip + 4 + signExtend((hw1 & 0xff) << 1, 9)) | 1;
+		}else if((hw1 & 0xf800) == 0xe000){
+			insn->type = THUMB_INSN_B;
+			insn->target = (ip + 4 + signExtend((hw1 & 0x7ff) << 1, 12)) | 1;
+		}else if((hw1 & 0xf500) == 0xb100){
+			insn->type = THUMB_INSN_CBZ;
+			insn->target = (ip + 4 + (((hw1 >> 9) & 1) << 6 | ((hw1 >> 3) & 0x1f) << 1)) | 1;
+		}else if((hw1 & 0xf800) == 0x4800){
+			insn->type = THUMB_INSN_LDR;
+			insn->reg = (hw1 >> 8) & 7;
+			insn->target = base + (hw1 & 0xff) * 4;
+		}else if((hw1 & 0xf800) == 0xa000){
+			insn->type = THUMB_INSN_ADR;
+			insn->reg = (hw1 >> 8) & 7;
+			insn->target = base + (hw1 & 0xff) * 4;
+		}else if((hw1 & 0xfd78) == 0x4478){
+			// add rdn, pc and mov rd, pc read pc + 4 without alignment
+			insn->type = hw1 & 0x200 ? THUMB_INSN_MOV_PC : THUMB_INSN_ADD_PC;
+			insn->reg = (hw1 & 7) | ((hw1 >> 4) & 8);
+			insn->target = ip + 4;
+			if(insn->reg == 13 || insn->reg == 15){
+				insn->type = THUMB_INSN_BAD;
+			}
+		}else if((hw1 & 0xff00) == 0xbf00 && (hw1 & 0xf)){
+			insn->type = THUMB_INSN_IT;
+			insn->cond = (hw1 >> 4) & 0xf;
+		}else if((hw1 & 0xff87) == 0x4700 || (hw1 & 0xff87) == 0x4687 || (hw1 & 0xff00) == 0xbd00){
+			// bx rm, mov pc, rm, pop {..., pc}
+			insn->type = THUMB_INSN_RETURN;
+		}
+		return;
+	}
+
+	uint16_t hw2 = readHalf(code + 2);
+	insn->length = 4;
+
+	if((hw1 & 0xf800) == 0xf000 && (hw2 & 0x8000)){
+		uint32_t s = (hw1 >> 10) & 1;
+		uint32_t j1 = (hw2 >> 13) & 1;
+		uint32_t j2 = (hw2 >> 11) & 1;
+		int32_t offset = signExtend(s << 24 | !(j1 ^ s) << 23 | !(j2 ^ s) << 22 | (hw1 & 0x3ff) << 12 | (hw2 & 0x7ff) << 1, 25);
+
+		switch(hw2 & 0x5000){
+		case 0x1000:
+			insn->type = THUMB_INSN_B;
+			insn->target = (ip + 4 + offset) | 1;
+			break;
+
+		case 0x5000:
+			insn->type = THUMB_INSN_BL;
+			insn->target = (ip + 4 + offset) | 1;
+			break;
+
+		case 0x4000:
+			// blx to arm code
+			insn->type = THUMB_INSN_BL;
+			insn->target = base + offset;
+			break;
+
+		default:
+			// cond 111x are msr, mrs and the other control instructions
+			if(((hw1 >> 6) & 0xf) < COND_AL){
+				insn->type = THUMB_INSN_BCC;
+				insn->cond = (hw1 >> 6) & 0xf;
+				offset = signExtend(s << 20 | j2 << 19 | j1 << 18 | (hw1 & 0x3f) << 12 | (hw2 & 0x7ff) << 1, 21);
+				insn->target = (ip + 4 + offset) | 1;
+			}
+			break;
+		}
+	}else if((hw1 & 0xfe1f) == 0xf81f){
+		int size = (hw1 >> 5) & 3;
+		uint32_t imm = hw2 & 0xfff;
+
+		insn->type = THUMB_INSN_LDR;
+		insn->reg = hw2 >> 12;
+		insn->target = hw1 & 0x80 ? base + imm : base - imm;
+
+		if(insn->reg == 15){
+			// ldr pc, [pc, #imm] is a branch through the literal pool
+			insn->type = size == 2 ? THUMB_INSN_BAD : THUMB_INSN_PLD;
+		}else if(size == 3 || (size == 2 && (hw1 & 0x100))){
+			insn->type = THUMB_INSN_BAD;
+		}
+	}else if((hw1 & 0xff7f) == 0xe95f){
+		uint32_t imm = (hw2 & 0xff) * 4;
+
+		insn->type = THUMB_INSN_LDRD;
+		insn->reg = hw2 >> 12;
+		insn->target = hw1 & 0x80 ? base + imm : base - imm;
+	}else if((hw1 & 0xff3f) == 0xed1f && (hw2 & 0x0e00) == 0x0a00){
+		uint32_t imm = (hw2 & 0xff) * 4;
+
+		insn->type = THUMB_INSN_VLDR;
+		insn->target = hw1 & 0x80 ? base + imm : base - imm;
+	}else if(((hw1 & 0xfbff) == 0xf20f || (hw1 & 0xfbff) == 0xf2af) && !(hw2 & 0x8000)){
+		uint32_t imm = ((hw1 >> 10) & 1) << 11 | ((hw2 >> 12) & 7) << 8 | (hw2 & 0xff);
+
+		insn->type = THUMB_INSN_ADR;
+		insn->reg = (hw2 >> 8) & 0xf;
+		insn->target = hw1 & 0x80 ? base - imm : base + imm;
+	}else if((hw1 & 0xfff0) == 0xe8d0 && (hw2 & 0xffe0) == 0xf000){
+		// tbb/tbh, a table right after the instruction can not be moved
+		insn->type = (hw1 & 0xf) == 15 ? THUMB_INSN_BAD : THUMB_INSN_RETURN;
+	}else if((hw1 == 0xe8bd && (hw2 & 0x8000)) || (hw1 == 0xf85d && hw2 == 0xfb04)){
+		// pop.w {..., pc}, ldr pc, [sp], #4
+		insn->type = THUMB_INSN_RETURN;
+	}
+}
+
+/**
+ * 重定位一条非IT指令, 条件只来自IT块时按无条件处理
+ */
+static int writeThumbInsn(uint8_t *dst, uint32_t pc, const uint8_t *code, const ThumbInsn *insn){
+	size_t out = 0;
+	uint16_t hw1 = readHalf(code);
+	uint16_t hw2 = insn->length == 4 ? readHalf(code + 2) : 0;
+	int reg = insn->reg;
+
+	switch(insn->type){
+	case THUMB_INSN_B:
+		return writeThumbJump(dst, pc, insn->target);
+
+	case THUMB_INSN_BCC:
+		return writeThumbCondJump(dst, pc, insn->cond, insn->target);
+
+	case THUMB_INSN_CBZ:
+		// cbz only branches forward, cbnz skips the far jump instead
+		return writeThumbSkip(dst, pc, (hw1 ^ 0x800) & ~0x2f8, insn->target);
+
+	case THUMB_INSN_BL:
+		return writeThumbCall(dst, pc, insn->target);
+
+	case THUMB_INSN_LDR:
+		// the destination register is its own base, ldr rt, [rt]
+		if(insn->length == 2){
+			hw1 = 0xf85f;
+			hw2 = reg << 12;
+		}
+		emitMovConst(dst, &out, reg, insn->target);
+		emit32(dst, &out, (hw1 & 0xfff0) | 0x80 | reg, hw2 & 0xf000);
+		return out;
+
+	case THUMB_INSN_LDRD:
+		emitMovConst(dst, &out, reg, insn->target);
+		emit32(dst, &out, 0xe9d0 | reg, hw2 & 0xff00);
+		return out;
+
+	case THUMB_INSN_VLDR:
+		// push {r0}; r0 = addr; vldr [r0]; pop {r0}
+		emit16(dst, &out, 0xb401);
+		emitMovConst(dst, &out, 0, insn->target);
+		emit32(dst, &out, (hw1 & 0xfff0) | 0x80, hw2 & 0xff00);
+		emit16(dst, &out, 0xbc01);
+		return out;
+
+	case THUMB_INSN_PLD:
+		return 0;
+
+	case THUMB_INSN_ADR:
+	case THUMB_INSN_MOV_PC:
+		emitMovConst(dst, &out, reg, insn->target);
+		return out;
+
+	case THUMB_INSN_ADD_PC: {
+		// push {rs}; rs = pc; add rdn, rs; pop {rs}, the 16-bit add leaves the flags alone
+		int scratch = reg ? 0 : 1;
+		emit16(dst, &out, 0xb400 | 1 << scratch);
+		emitMovConst(dst, &out, scratch, insn->target);
+		emit16(dst, &out, 0x4400 | (reg & 8) << 4 | scratch << 3 | (reg & 7));
+		emit16(dst, &out, 0xbc00 | 1 << scratch);
+		return out;
+	}
+
+	default:
+		memcpy(dst, code, insn->length);
+		return insn->length;
+	}
+}
+
+static inline bool needsFixup(const ThumbInsn *insn){
+	return insn->type != THUMB_INSN_OTHER && insn->type != THUMB_INSN_RETURN;
+}
+
+static inline bool isBranch(const ThumbInsn *insn){
+	return insn->type == THUMB_INSN_B || insn->type == THUMB_INSN_BCC || insn->type == THUMB_INSN_CBZ
+			|| insn->type == THUMB_INSN_BL;
+}
+
+/**
+ * 重定位IT块, 块里没有要修正的指令时原样复制, 否则拆成单条指令的IT块,
+ * 要修正的指令改成反条件跳过无条件的重定位结果, 它们都不改标志位
+ */
+static int writeThumbItBlock(uint8_t *dst, uint32_t pc, const uint8_t *code, size_t size,
+		const ThumbInsn *insns, const uint8_t *conds, int count){
+	bool fixup = false;
+	for(int i = 0; i < count; i++){
+		fixup |= needsFixup(insns + i);
+	}
+
+	if(!fixup){
+		memcpy(dst, code, size);
+		return size;
+	}
+
+	size_t out = 0;
+	size_t off = 2;
+	for(int i = 0; i < count; i++){
+		const ThumbInsn *insn = insns + i;
+		int cond = conds[i];
+
+		if(!needsFixup(insn)){
+			emit16(dst, &out, 0xbf08 | cond << 4);
+			memcpy(dst + out, code + off, insn->length);
+			out += insn->length;
+		}else if(cond == COND_AL){
+			out += writeThumbInsn(dst + out, pc + out, code + off, insn);
+		}else{
+			int n = writeThumbInsn(dst + out + 2, pc + out + 2, code + off, insn);
+			if(n){
+				emit16(dst, &out, 0xd000 | (cond ^ 1) << 8 | (n - 2) >> 1);
+				out += n;
+			}
+		}
+
+		off += insn->length;
+	}
+
+	return out;
+}
+
+int relocateThumb(const uint8_t *src, uint32_t src_pc, size_t min_len, uint8_t *dst, size_t dst_size, uint32_t pc, size_t *stolen){
+	uint32_t targets[16];
+	size_t ntargets = 0;
+
+	size_t off = 0;
+	size_t out = 0;
+
+	while(off < min_len){
+		ThumbInsn insns[5];
+		uint8_t conds[4];
+		int count = 0;
+
+		decodeThumbInsn(src + off, src_pc + off, insns);
+		if(insns[0].type == THUMB_INSN_BAD){
+			return -1;
+		}
+
+		size_t size = insns[0].length;
+		if(insns[0].type == THUMB_INSN_IT){
+			// the condition of each instruction comes from the shifting ITSTATE
+			uint8_t state = readHalf(src + off) & 0xff;
+			while(state & 0xf){
+				conds[count] = state >> 4;
+
+				ThumbInsn *insn = insns + 1 + count;
+				decodeThumbInsn(src + off + size, src_pc + off + size, insn);
+				if(insn->type == THUMB_INSN_BAD || insn->type == THUMB_INSN_IT){
+					return -1;
+				}
+
+				size += insn->length;
+				count++;
+				state = (state & 0xe0) | ((state << 1) & 0x1f);
+			}
+		}
+
+		if(out + MAX_RELOCATED * (count + 1) > dst_size){
+			return -1;
+		}
+
+		uint32_t npc = pc + out;
+		if(count){
+			out += writeThumbItBlock(dst + out, npc, src + off, size, insns + 1, conds, count);
+		}else{
+			out += writeThumbInsn(dst + out, npc, src + off, insns);
+		}
+
+		for(int i = 0; i <= count; i++){
+			if(isBranch(insns + i) && ntargets < sizeof(targets) / sizeof(targets[0])){
+				targets[ntargets++] = insns[i].target & ~1u;
+			}
+		}
+
+		off += size;
+
+		// the function ends before enough bytes could be taken
+		if(off < min_len && !count && (insns[0].type == THUMB_INSN_B || insns[0].type == THUMB_INSN_RETURN)){
+			return -1;
+		}
+	}
+
+	// a branch back into the stolen bytes would land in the middle of the patch
+	for(size_t i = 0; i < ntargets; i++){
+		if(targets[i] >= src_pc && targets[i] < src_pc + off){
+			return -1;
+		}
+	}
+
+	if(out + 10 > dst_size){
+		return -1;
+	}
+
+	out += writeThumbJump(dst + out, pc + out, (src_pc + off) | 1);
+
+	*stolen = off;
+	return out;
+}
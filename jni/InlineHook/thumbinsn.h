@@ -0,0 +1,27 @@
+/*
+ * thumbinsn.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef THUMBINSN_H_
+#define THUMBINSN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * 把src开始至少min_len字节的Thumb-2指令重定位到dst, src原本位于src_pc, dst运行时位于pc, 地址都不带thumb位
+ * 只读写字节缓冲区, 不依赖当前进程的架构, IT块会整体拿走
+ * stolen返回拿走的原指令字节数, 返回写入dst的字节数, 失败返回-1
+ */
+int relocateThumb(const uint8_t *src, uint32_t src_pc, size_t min_len, uint8_t *dst, size_t dst_size, uint32_t pc, size_t *stolen);
+
+/**
+ * 在dst写入跳到target的指令, target最低位为1时是thumb代码
+ * 距离在±16MB以内时4字节(b.w), 否则8字节(ldr.w pc, [pc]), pc未4字节对齐时前面多一个nop
+ */
+int writeThumbJump(uint8_t *dst, uint32_t pc, uint32_t target);
+
+#endif /* THUMBINSN_H_ */
@@ -0,0 +1,401 @@
+/*
+ * x64insn.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <string.h>
+
+#include "x64insn.h"
+
+#define M	0x001	// modrm
+#define I8	0x002	// imm8
+#define I16	0x004	// imm16
+#define IZ	0x008	// imm16/imm32
+#define IV	0x010	// imm16/imm32/imm64, mov r, imm
+#define R8	0x020	// rel8
+#define RZ	0x040	// rel32
+#define MO	0x080	// moffs, mov al/ax, [imm64]
+#define X	0x100	// invalid in 64-bit mode, or handled elsewhere
+
+static const uint16_t onebyte[256] = {
+	/* 00 */ M, M, M, M, I8, IZ, X, X, M, M, M, M, I8, IZ, X, X,
+	/* 10 */ M, M, M, M, I8, IZ, X, X, M, M, M, M, I8, IZ, X, X,
+	/* 20 */ M, M, M, M, I8, IZ, X, X, M, M, M, M, I8, IZ, X, X,
+	/* 30 */ M, M, M, M, I8, IZ, X, X, M, M, M, M, I8, IZ, X, X,
+	/* 40 */ X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	/* 50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 60 */ X, X, X, M, X, X, X, X, IZ, M|IZ, I8, M|I8, 0, 0, 0, 0,
+	/* 70 */ R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8,
+	/* 80 */ M|I8, M|IZ, X, M|I8, M, M, M, M, M, M, M, M, M, M, M, M,
+	/* 90 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, X, 0, 0, 0, 0, 0,
+	/* A0 */ MO, MO, MO, MO, 0, 0, 0, 0, I8, IZ, 0, 0, 0, 0, 0, 0,
+	/* B0 */ I8, I8, I8, I8, I8, I8, I8, I8, IV, IV, IV, IV, IV, IV, IV, IV,
+	/* C0 */ M|I8, M|I8, I16, 0, X, X, M|I8, M|IZ, I16|I8, 0, I16, 0, 0, I8, X, 0,
+	/* D0 */ M, M, M, M, X, X, X, 0, M, M, M, M, M, M, M, M,
+	/* E0 */ R8, R8, R8, R8, I8, I8, I8, I8, RZ, RZ, X, R8, 0, 0, 0, 0,
+	/* F0 */ X, 0, X, X, 0, 0, M, M, 0, 0, 0, 0, 0, 0, M, M
+};
+
+static const uint16_t twobyte[256] = {
+	/* 00 */ M, M, M, M, X, 0, 0, 0, 0, 0, X, 0, X, M, 0, M|I8,
+	/* 10 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	/* 20 */ M, M, M, M, X, X, X, X, M, M, M, M, M, M, M, M,
+	/* 30 */ 0, 0, 0, 0, 0, 0, X, 0, X, X, X, X, X, X, X, X,
+	/* 40 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	/* 50 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	/* 60 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	/* 70 */ M|I8, M|I8, M|I8, M|I8, M, M, M, 0, M, M, X, X, M, M, M, M,
+	/* 80 */ RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ,
+	/* 90 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	/* A0 */ 0, 0, 0, M, M|I8, M, X, X, 0, 0, 0, M, M|I8, M, M, M,
+	/* B0 */ M, M, M, M, M, M, M, M, M, M, M|I8, M, M, M, M, M,
+	/* C0 */ M, M, M|I8, M, M|I8, M|I8, M|I8, M, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* D0 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	/* E0 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	/* F0 */ M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M
+};
+
+static inline bool isPrefix(uint8_t byte){
+	switch(byte){
+	case 0x26: case 0x2e: case 0x36: case 0x3e: case 0x64: case 0x65:
+	case 0x66: case 0x67: case 0xf0: case 0xf2: case 0xf3:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static inline bool fitsInt32(int64_t value){
+	return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+bool decodeX64Insn(const uint8_t *code, size_t size, X64Insn *insn){
+	const uint8_t *p = code;
+	const uint8_t *end = code + (size < 15 ? size : 15);
+
+	bool opsize16 = false, addr32 = false, rexw = false, twobytes = false;
+
+	memset(insn, 0, sizeof(X64Insn));
+
+	while(p < end && isPrefix(*p)){
+		opsize16 |= *p == 0x66;
+		addr32 |= *p == 0x67;
+		p++;
+	}
+
+	if(p < end && (*p & 0xf0) == 0x40){
+		rexw = *p & 0x08;
+		p++;
+	}
+
+	if(p >= end){
+		return false;
+	}
+
+	uint8_t op = *p++;
+	uint16_t flags = 0;
+
+	if(op == 0x0f){
+		if(p >= end){
+			return false;
+		}
+
+		op = *p++;
+		twobytes = true;
+
+		if(op == 0x38 || op == 0x3a){
+			// three byte opcodes all have a modrm, 0F 3A also an imm8
+			if(p >= end){
+				return false;
+			}
+			flags = op == 0x3a ? M|I8 : M;
+			op = *p++;
+		}else{
+			flags = twobyte[op];
+		}
+	}else if(op == 0xc4 || op == 0xc5 || op == 0x62){
+		// VEX/EVEX, the payload selects the opcode map
+		size_t payload = op == 0xc5 ? 1 : (op == 0xc4 ? 2 : 3);
+		if(p + payload >= end){
+			return false;
+		}
+
+		unsigned map = op == 0xc5 ? 1 : (op == 0xc4 ? p[0] & 0x1f : p[0] & 0x07);
+		p += payload;
+		op = *p++;
+		twobytes = true;
+
+		// vzeroupper/vzeroall are the only ones without a modrm
+		flags = map == 1 && op == 0x77 ? 0 : M;
+		if(map == 3){
+			flags |= I8;
+		}else if(map == 1){
+			flags |= twobyte[op] & I8;
+		}
+	}else{
+		flags = onebyte[op];
+
+		// test r/m, imm only for /0 and /1
+		if((op == 0xf6 || op == 0xf7) && p < end && ((*p >> 3) & 7) < 2){
+			flags |= op == 0xf6 ? I8 : IZ;
+		}
+	}
+
+	if(flags & X){
+		return false;
+	}
+
+	if(flags & M){
+		if(p >= end){
+			return false;
+		}
+
+		uint8_t modrm = *p++;
+		uint8_t mod = modrm >> 6;
+		uint8_t rm = modrm & 7;
+		size_t disp = 0;
+
+		if(mod != 3){
+			if(rm == 4){
+				if(p >= end){
+					return false;
+				}
+				if(mod == 0 && (*p & 7) == 5){
+					disp = 4;
+				}
+				p++;
+			}else if(mod == 0 && rm == 5){
+				insn->rip_relative = true;
+				insn->disp_offset = p - code;
+				disp = 4;
+			}
+
+			if(mod == 1){
+				disp = 1;
+			}else if(mod == 2){
+				disp = 4;
+			}
+		}
+
+		if(!twobytes && op == 0xff && (((modrm >> 3) & 7) == 4 || ((modrm >> 3) & 7) == 5)){
+			insn->type = X64_INSN_JMP_INDIRECT;
+		}
+
+		p += disp;
+	}
+
+	size_t imm = 0;
+	if(flags & I8){
+		imm += 1;
+	}
+	if(flags & I16){
+		imm += 2;
+	}
+	if(flags & IZ){
+		imm += opsize16 && !rexw ? 2 : 4;
+	}
+	if(flags & IV){
+		imm += rexw ? 8 : (opsize16 ? 2 : 4);
+	}
+	if(flags & MO){
+		imm += addr32 ? 4 : 8;
+	}
+
+	if(flags & (R8 | RZ)){
+		insn->rel_offset = p - code;
+		insn->rel_size = flags & R8 ? 1 : 4;
+		imm += insn->rel_size;
+	}
+
+	p += imm;
+	if(p > end){
+		return false;
+	}
+
+	insn->length = p - code;
+	insn->opcode = op;
+
+	if(twobytes){
+		if(op >= 0x80 && op <= 0x8f && (flags & RZ)){
+			insn->type = X64_INSN_JCC;
+		}
+	}else if(op == 0xeb || op == 0xe9){
+		insn->type = X64_INSN_JMP;
+	}else if(op >= 0x70 && op <= 0x7f){
+		insn->type = X64_INSN_JCC;
+	}else if(op == 0xe8){
+		insn->type = X64_INSN_CALL;
+	}else if(op >= 0xe0 && op <= 0xe3){
+		insn->type = X64_INSN_LOOP;
+	}else if(op == 0xc2 || op == 0xc3 || op == 0xca || op == 0xcb || op == 0xcf){
+		insn->type = X64_INSN_RET;
+	}
+
+	return true;
+}
+
+uintptr_t getX64InsnTarget(const uint8_t *code, const X64Insn *insn, uintptr_t pc){
+	int32_t rel = 0;
+
+	if(insn->rel_size == 1){
+		rel = (int8_t)code[insn->rel_offset];
+	}else if(insn->rel_size == 4){
+		memcpy(&rel, code + insn->rel_offset, 4);
+	}else if(insn->rip_relative){
+		memcpy(&rel, code + insn->disp_offset, 4);
+	}else{
+		return 0;
+	}
+
+	return pc + insn->length + (intptr_t)rel;
+}
+
+int writeX64Jump(uint8_t *dst, uintptr_t pc, uintptr_t target){
+	int64_t rel = (int64_t)(target - (pc + 5));
+
+	if(fitsInt32(rel)){
+		int32_t rel32 = (int32_t)rel;
+		dst[0] = 0xe9;
+		memcpy(dst + 1, &rel32, 4);
+		return 5;
+	}
+
+	// jmp [rip + 0]; .quad target
+	static const uint8_t absjmp[6] = {0xff, 0x25, 0x00, 0x00, 0x00, 0x00};
+	memcpy(dst, absjmp, 6);
+	memcpy(dst + 6, &target, 8);
+	return 14;
+}
+
+static int writeX64Jcc(uint8_t *dst, uintptr_t pc, uint8_t cc, uintptr_t target){
+	int64_t rel = (int64_t)(target - (pc + 6));
+
+	if(fitsInt32(rel)){
+		int32_t rel32 = (int32_t)rel;
+		dst[0] = 0x0f;
+		dst[1] = 0x80 | cc;
+		memcpy(dst + 2, &rel32, 4);
+		return 6;
+	}
+
+	// the inverted condition skips the jump, which may still come out as a rel32 from here
+	int len = writeX64Jump(dst + 2, pc + 2, target);
+	dst[0] = 0x70 | (cc ^ 1);
+	dst[1] = len;
+	return 2 + len;
+}
+
+static int writeX64Call(uint8_t *dst, uintptr_t pc, uintptr_t target){
+	int64_t rel = (int64_t)(target - (pc + 5));
+
+	if(fitsInt32(rel)){
+		int32_t rel32 = (int32_t)rel;
+		dst[0] = 0xe8;
+		memcpy(dst + 1, &rel32, 4);
+		return 5;
+	}
+
+	// call [rip + 2]; jmp +8; .quad target
+	static const uint8_t abscall[8] = {0xff, 0x15, 0x02, 0x00, 0x00, 0x00, 0xeb, 0x08};
+	memcpy(dst, abscall, 8);
+	memcpy(dst + 8, &target, 8);
+	return 16;
+}
+
+// the longest sequence a single instruction can become
+#define MAX_RELOCATED 32
+
+int relocateX64(const uint8_t *src, size_t min_len, uint8_t *dst, size_t dst_size, uintptr_t pc, size_t *stolen){
+	uintptr_t start = (uintptr_t)src;
+	uintptr_t targets[16];
+	size_t ntargets = 0;
+
+	size_t off = 0;
+	size_t out = 0;
+
+	while(off < min_len){
+		X64Insn insn;
+		if(out + MAX_RELOCATED > dst_size || !decodeX64Insn(src + off, 15, &insn)){
+			return -1;
+		}
+
+		const uint8_t *code = src + off;
+		uintptr_t ip = start + off;
+		uintptr_t npc = pc + out;
+		uintptr_t target = getX64InsnTarget(code, &insn, ip);
+
+		switch(insn.type){
+		case X64_INSN_JMP:
+			out += writeX64Jump(dst + out, npc, target);
+			break;
+
+		case X64_INSN_JCC:
+			out += writeX64Jcc(dst + out, npc, insn.opcode & 0x0f, target);
+			break;
+
+		case X64_INSN_CALL:
+			out += writeX64Call(dst + out, npc, target);
+			break;
+
+		case X64_INSN_LOOP: {
+			// loop L1; jmp L2; L1: jmp target; L2:
+			memcpy(dst + out, code, insn.rel_offset);
+			out += insn.rel_offset;
+			dst[out++] = 2;
+
+			uint8_t *skip = dst + out;
+			out += 2;
+			int n = writeX64Jump(dst + out, pc + out, target);
+			skip[0] = 0xeb;
+			skip[1] = n;
+			out += n;
+			break;
+		}
+
+		default:
+			memcpy(dst + out, code, insn.length);
+
+			if(insn.rip_relative){
+				int64_t disp = (int64_t)(target - (npc + insn.length));
+				if(!fitsInt32(disp)){
+					return -1;
+				}
+
+				int32_t disp32 = (int32_t)disp;
+				memcpy(dst + out + insn.disp_offset, &disp32, 4);
+			}
+
+			out += insn.length;
+			break;
+		}
+
+		if(insn.rel_size && ntargets < sizeof(targets) / sizeof(targets[0])){
+			targets[ntargets++] = target;
+		}
+
+		off += insn.length;
+
+		// the function ends before enough bytes could be taken
+		if(off < min_len && (insn.type == X64_INSN_JMP || insn.type == X64_INSN_RET || insn.type == X64_INSN_JMP_INDIRECT)){
+			return -1;
+		}
+	}
+
+	// a branch back into the stolen bytes would land in the middle of the patch
+	for(size_t i = 0; i < ntargets; i++){
+		if(targets[i] >= start && targets[i] < start + off){
+			return -1;
+		}
+	}
+
+	if(out + 14 > dst_size){
+		return -1;
+	}
+
+	out += writeX64Jump(dst + out, pc + out, start + off);
+
+	*stolen = off;
+	return out;
+}
@@ -0,0 +1,67 @@
+/*
+ * x64insn.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef X64INSN_H_
+#define X64INSN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * 指令类型, 只区分重定位时需要特殊处理的指令
+ */
+enum {
+	X64_INSN_OTHER = 0,
+	X64_INSN_JMP,		// EB rel8, E9 rel32
+	X64_INSN_JCC,		// 7x rel8, 0F 8x rel32
+	X64_INSN_CALL,		// E8 rel32
+	X64_INSN_LOOP,		// E0-E3 rel8, loop/jrcxz
+	X64_INSN_RET,		// C2, C3, CA, CB, CF
+	X64_INSN_JMP_INDIRECT	// FF /4, FF /5
+};
+
+/**
+ * 一条解码后的x86-64指令
+ */
+struct X64Insn {
+	uint8_t length;
+	uint8_t type;
+
+	// the opcode byte, 0F is not included for two byte opcodes
+	uint8_t opcode;
+
+	// [rip + disp32], disp_offset is the offset of disp32 in the instruction
+	bool rip_relative;
+	uint8_t disp_offset;
+
+	// relative branches, rel_offset and rel_size locate the displacement
+	uint8_t rel_offset;
+	uint8_t rel_size;
+};
+
+/**
+ * 解码一条指令的长度和重定位信息, 最多读取size字节, 无法识别时返回false
+ */
+bool decodeX64Insn(const uint8_t *code, size_t size, X64Insn *insn);
+
+/**
+ * 相对跳转/RIP相对寻址的目标地址, pc为指令所在地址
+ */
+uintptr_t getX64InsnTarget(const uint8_t *code, const X64Insn *insn, uintptr_t pc);
+
+/**
+ * 把src开始至少min_len字节的完整指令重定位到dst, dst运行时位于pc
+ * stolen返回拿走的原指令字节数, 返回写入dst的字节数, 失败返回-1
+ */
+int relocateX64(const uint8_t *src, size_t min_len, uint8_t *dst, size_t dst_size, uintptr_t pc, size_t *stolen);
+
+/**
+ * 在dst写入跳到target的指令, 距离在rel32以内时5字节, 否则14字节, 返回写入的字节数
+ */
+int writeX64Jump(uint8_t *dst, uintptr_t pc, uintptr_t target);
+
+#endif /* X64INSN_H_ */
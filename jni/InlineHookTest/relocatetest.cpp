@@ -0,0 +1,763 @@
+/*
+ * relocatetest.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "InlineHook/arm64insn.h"
+#include "InlineHook/thumbinsn.h"
+#include "InlineHook/x64insn.h"
+
+// little endian bytes of an instruction word, a halfword and a literal
+#define W(x) (uint8_t)(x), (uint8_t)((x) >> 8), (uint8_t)((x) >> 16), (uint8_t)((x) >> 24)
+#define H(x) (uint8_t)(x), (uint8_t)((x) >> 8)
+#define D(x) W((uint32_t)(x)), W((uint32_t)((uint64_t)(x) >> 32))
+
+#define OUT_SIZE 256
+
+/**
+ * 输出中offset处的指令引用的地址, 跳转目标或者加载的地址, 加载的字面量在输出中时为它的值
+ */
+struct RelocRef {
+	size_t offset;
+	uint64_t addr;
+};
+
+/**
+ * 一个用例, expect为NULL时期望重定位失败
+ */
+struct RelocCase {
+	const char *name;
+	const uint8_t *code;
+	size_t codesz;
+	uint64_t src_pc;
+	uint64_t pc;
+	size_t min_len;
+
+	size_t stolen;
+	const uint8_t *expect;
+	size_t expectsz;
+	const RelocRef *refs;
+	size_t nrefs;
+};
+
+#define RELOC_CASE(name, code, src_pc, pc, min_len, stolen, expect, refs) \
+	{name, code, sizeof(code), src_pc, pc, min_len, stolen, expect, sizeof(expect), refs, sizeof(refs) / sizeof(refs[0])}
+
+#define RELOC_FAIL(name, code, src_pc, pc, min_len) \
+	{name, code, sizeof(code), src_pc, pc, min_len, 0, NULL, 0, NULL, 0}
+
+typedef int (*Relocator)(const uint8_t *src, uint64_t src_pc, size_t min_len, uint8_t *dst, size_t dst_size, uint64_t pc, size_t *stolen);
+
+typedef bool (*RefDecoder)(const uint8_t *out, size_t size, size_t offset, uint64_t pc, uint64_t *addr);
+
+static inline int64_t signExtend(uint64_t value, int bits){
+	return (int64_t)(value << (64 - bits)) >> (64 - bits);
+}
+
+static inline uint32_t read32(const uint8_t *p){
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t read64(const uint8_t *p){
+	return read32(p) | (uint64_t)read32(p + 4) << 32;
+}
+
+/**
+ * 字面量落在输出中时读出它的值
+ */
+static inline uint64_t readLiteral(const uint8_t *out, size_t size, uint64_t pc, uint64_t addr, int bytes){
+	if(addr >= pc && addr + bytes <= pc + size){
+		return bytes == 8 ? read64(out + (addr - pc)) : read32(out + (addr - pc));
+	}
+
+	return addr;
+}
+
+/*
+ * AArch64
+ */
+
+#define A64_S 0x7000010000ULL
+#define A64_N (A64_S + 0x10000)
+#define A64_F (A64_S + 0x40000000)
+#define A64_V (A64_S + 0x200000000ULL)
+
+static int relocateA64(const uint8_t *src, uint64_t src_pc, size_t min_len, uint8_t *dst, size_t dst_size, uint64_t pc, size_t *stolen){
+	return relocateArm64(src, src_pc, min_len, dst, dst_size, pc, stolen);
+}
+
+static bool decodeA64Ref(const uint8_t *out, size_t size, size_t offset, uint64_t pc, uint64_t *addr){
+	uint32_t insn = read32(out + offset);
+	uint64_t ip = pc + offset;
+
+	if((insn & 0x7c000000) == 0x14000000){
+		*addr = ip + signExtend(insn & 0x3ffffff, 26) * 4;
+	}else if((insn & 0xff000010) == 0x54000000 || (insn & 0x7e000000) == 0x34000000){
+		*addr = ip + signExtend((insn >> 5) & 0x7ffff, 19) * 4;
+	}else if((insn & 0x7e000000) == 0x36000000){
+		*addr = ip + signExtend((insn >> 5) & 0x3fff, 14) * 4;
+	}else if((insn & 0x3b000000) == 0x18000000){
+		*addr = readLiteral(out, size, pc, ip + signExtend((insn >> 5) & 0x7ffff, 19) * 4, 8);
+	}else if((insn & 0x1f000000) == 0x10000000){
+		int64_t imm = signExtend(((insn >> 5) & 0x7ffff) << 2 | ((insn >> 29) & 3), 21);
+		*addr = insn & 0x80000000 ? (ip & ~(uint64_t)0xfff) + imm * 4096 : ip + imm;
+	}else{
+		return false;
+	}
+
+	return true;
+}
+
+static const uint8_t a64_bcond[] = {W(0x54000801)};		// b.ne #0x100
+static const uint8_t a64_cbz[] = {W(0xb4000200)};		// cbz x0, #0x40
+static const uint8_t a64_tbz[] = {W(0x36180101)};		// tbz w1, #3, #0x20
+static const uint8_t a64_adrp[] = {W(0xb0000000)};		// adrp x0, #0x1000
+static const uint8_t a64_adr[] = {W(0x10000201)};		// adr x1, #0x40
+static const uint8_t a64_ldr[] = {W(0x58000402)};		// ldr x2, #0x80
+static const uint8_t a64_ldrsw[] = {W(0x98000404)};		// ldrsw x4, #0x80
+static const uint8_t a64_ldrq[] = {W(0x9c000400)};		// ldr q0, #0x80
+static const uint8_t a64_prfm[] = {W(0xd8000400)};		// prfm pldl1keep, #0x80
+static const uint8_t a64_bl[] = {W(0x94000400)};		// bl #0x1000
+static const uint8_t a64_b[] = {W(0x14000800)};			// b #0x2000
+static const uint8_t a64_prologue[] = {
+	W(0xa9bf7bfd),	// stp x29, x30, [sp, #-16]!
+	W(0x910003fd),	// mov x29, sp
+	W(0xb0000000),	// adrp x0, #0x1000
+	W(0x58000402),	// ldr x2, #0x80
+};
+static const uint8_t a64_loop[] = {
+	W(0xd503201f),	// nop
+	W(0x54ffffe0),	// b.eq #-4
+};
+
+static const uint8_t a64_bcond_near_out[] = {
+	W(0x54f80801),	// b.ne #-65280
+	W(0x17ffc000),	// b #-65536
+};
+static const RelocRef a64_bcond_near_refs[] = {{0, A64_S + 0x100}, {4, A64_S + 4}};
+static const uint8_t a64_bcond_far_out[] = {
+	W(0x540000a0),	// b.eq #20
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010100),
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_bcond_far_refs[] = {{0, A64_F + 20}, {4, A64_S + 0x100}, {20, A64_S + 4}};
+static const uint8_t a64_cbz_near_out[] = {
+	W(0xb4f80200),	// cbz x0, #-65472
+	W(0x17ffc000),	// b #-65536
+};
+static const RelocRef a64_cbz_near_refs[] = {{0, A64_S + 0x40}, {4, A64_S + 4}};
+static const uint8_t a64_cbz_far_out[] = {
+	W(0xb50000a0),	// cbnz x0, #20
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010040),
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_cbz_far_refs[] = {{0, A64_F + 20}, {4, A64_S + 0x40}, {20, A64_S + 4}};
+static const uint8_t a64_tbz_near_out[] = {
+	W(0x361f8101),	// tbz w1, #3, #-4064
+	W(0x17fffc00),	// b #-4096
+};
+static const RelocRef a64_tbz_near_refs[] = {{0, A64_S + 0x20}, {4, A64_S + 4}};
+static const uint8_t a64_tbz_far_out[] = {
+	W(0x37180041),	// tbnz w1, #3, #8
+	W(0x17ffc007),	// b #-65508
+	W(0x17ffbfff),	// b #-65540
+};
+static const RelocRef a64_tbz_far_refs[] = {{0, A64_N + 8}, {4, A64_S + 0x20}, {8, A64_S + 4}};
+static const uint8_t a64_adrp_near_out[] = {
+	W(0xb0e00000),	// adrp x0, #-1073737728
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_adrp_near_refs[] = {{0, A64_S + 0x1000}, {4, A64_S + 4}};
+static const uint8_t a64_adrp_far_out[] = {
+	W(0x58000040),	// ldr x0, #8
+	W(0x14000003),	// b #12
+	D(0x7000011000),
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_adrp_far_refs[] = {{0, A64_S + 0x1000}, {4, A64_V + 16}, {16, A64_S + 4}};
+static const uint8_t a64_adr_near_out[] = {
+	W(0x10f80201),	// adr x1, #-65472
+	W(0x17ffc000),	// b #-65536
+};
+static const RelocRef a64_adr_near_refs[] = {{0, A64_S + 0x40}, {4, A64_S + 4}};
+static const uint8_t a64_adr_far_out[] = {
+	W(0x58000041),	// ldr x1, #8
+	W(0x14000003),	// b #12
+	D(0x7000010040),
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_adr_far_refs[] = {{0, A64_S + 0x40}, {4, A64_F + 16}, {16, A64_S + 4}};
+static const uint8_t a64_ldr_near_out[] = {
+	W(0x58f80402),	// ldr x2, #-65408
+	W(0x17ffc000),	// b #-65536
+};
+static const RelocRef a64_ldr_near_refs[] = {{0, A64_S + 0x80}, {4, A64_S + 4}};
+static const uint8_t a64_ldr_far_out[] = {
+	W(0x58000042),	// ldr x2, #8
+	W(0x14000003),	// b #12
+	D(0x7000010080),
+	W(0xf9400042),	// ldr x2, [x2]
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_ldr_far_refs[] = {{0, A64_S + 0x80}, {4, A64_F + 16}, {20, A64_S + 4}};
+static const uint8_t a64_ldrsw_far_out[] = {
+	W(0x58000044),	// ldr x4, #8
+	W(0x14000003),	// b #12
+	D(0x7000010080),
+	W(0xb9800084),	// ldrsw x4, [x4]
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_ldrsw_far_refs[] = {{0, A64_S + 0x80}, {4, A64_F + 16}, {20, A64_S + 4}};
+static const uint8_t a64_ldrq_far_out[] = {
+	W(0x58000051),	// ldr x17, #8
+	W(0x14000003),	// b #12
+	D(0x7000010080),
+	W(0x3dc00220),	// ldr q0, [x17]
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_ldrq_far_refs[] = {{0, A64_S + 0x80}, {4, A64_F + 16}, {20, A64_S + 4}};
+static const uint8_t a64_prfm_near_out[] = {
+	W(0xd8f80400),	// prfm pldl1keep, #-65408
+	W(0x17ffc000),	// b #-65536
+};
+static const RelocRef a64_prfm_near_refs[] = {{0, A64_S + 0x80}, {4, A64_S + 4}};
+static const uint8_t a64_prfm_far_out[] = {
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_prfm_far_refs[] = {{0, A64_S + 4}};
+static const uint8_t a64_bl_near_out[] = {
+	W(0x97ffc400),	// bl #-61440
+	W(0x17ffc000),	// b #-65536
+};
+static const RelocRef a64_bl_near_refs[] = {{0, A64_S + 0x1000}, {4, A64_S + 4}};
+static const uint8_t a64_bl_far_out[] = {
+	W(0x58000071),	// ldr x17, #12
+	W(0xd63f0220),	// blr x17
+	W(0x14000003),	// b #12
+	D(0x7000011000),
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_bl_far_refs[] = {{0, A64_S + 0x1000}, {8, A64_F + 20}, {20, A64_S + 4}};
+static const uint8_t a64_b_far_out[] = {
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000012000),
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010004),
+};
+static const RelocRef a64_b_far_refs[] = {{0, A64_S + 0x2000}, {16, A64_S + 4}};
+static const uint8_t a64_prologue_out[] = {
+	W(0xa9bf7bfd),	// stp x29, x30, [sp, #-16]!
+	W(0x910003fd),	// mov x29, sp
+	W(0xb0e00000),	// adrp x0, #-1073737728
+	W(0x58000042),	// ldr x2, #8
+	W(0x14000003),	// b #12
+	D(0x700001008c),
+	W(0xf9400042),	// ldr x2, [x2]
+	W(0x58000051),	// ldr x17, #8
+	W(0xd61f0220),	// br x17
+	D(0x7000010010),
+};
+static const RelocRef a64_prologue_refs[] = {{8, A64_S + 0x1000}, {12, A64_S + 0x8c}, {16, A64_F + 28}, {32, A64_S + 16}};
+
+static const RelocCase a64_cases[] = {
+	RELOC_CASE("b.cond near", a64_bcond, A64_S, A64_N, 4, 4, a64_bcond_near_out, a64_bcond_near_refs),
+	RELOC_CASE("b.cond far", a64_bcond, A64_S, A64_F, 4, 4, a64_bcond_far_out, a64_bcond_far_refs),
+	RELOC_CASE("cbz near", a64_cbz, A64_S, A64_N, 4, 4, a64_cbz_near_out, a64_cbz_near_refs),
+	RELOC_CASE("cbz far", a64_cbz, A64_S, A64_F, 4, 4, a64_cbz_far_out, a64_cbz_far_refs),
+	RELOC_CASE("tbz near", a64_tbz, A64_S, A64_S + 0x1000, 4, 4, a64_tbz_near_out, a64_tbz_near_refs),
+	RELOC_CASE("tbz far", a64_tbz, A64_S, A64_N, 4, 4, a64_tbz_far_out, a64_tbz_far_refs),
+	RELOC_CASE("adrp near", a64_adrp, A64_S, A64_F, 4, 4, a64_adrp_near_out, a64_adrp_near_refs),
+	RELOC_CASE("adrp far", a64_adrp, A64_S, A64_V, 4, 4, a64_adrp_far_out, a64_adrp_far_refs),
+	RELOC_CASE("adr near", a64_adr, A64_S, A64_N, 4, 4, a64_adr_near_out, a64_adr_near_refs),
+	RELOC_CASE("adr far", a64_adr, A64_S, A64_F, 4, 4, a64_adr_far_out, a64_adr_far_refs),
+	RELOC_CASE("ldr literal near", a64_ldr, A64_S, A64_N, 4, 4, a64_ldr_near_out, a64_ldr_near_refs),
+	RELOC_CASE("ldr literal far", a64_ldr, A64_S, A64_F, 4, 4, a64_ldr_far_out, a64_ldr_far_refs),
+	RELOC_CASE("ldrsw literal far", a64_ldrsw, A64_S, A64_F, 4, 4, a64_ldrsw_far_out, a64_ldrsw_far_refs),
+	RELOC_CASE("ldr q literal far", a64_ldrq, A64_S, A64_F, 4, 4, a64_ldrq_far_out, a64_ldrq_far_refs),
+	RELOC_CASE("prfm literal near", a64_prfm, A64_S, A64_N, 4, 4, a64_prfm_near_out, a64_prfm_near_refs),
+	RELOC_CASE("prfm literal far", a64_prfm, A64_S, A64_F, 4, 4, a64_prfm_far_out, a64_prfm_far_refs),
+	RELOC_CASE("bl near", a64_bl, A64_S, A64_N, 4, 4, a64_bl_near_out, a64_bl_near_refs),
+	RELOC_CASE("bl far", a64_bl, A64_S, A64_F, 4, 4, a64_bl_far_out, a64_bl_far_refs),
+	RELOC_CASE("b far", a64_b, A64_S, A64_F, 4, 4, a64_b_far_out, a64_b_far_refs),
+	RELOC_CASE("prologue", a64_prologue, A64_S, A64_F, 16, 16, a64_prologue_out, a64_prologue_refs),
+	RELOC_FAIL("branch into stolen bytes", a64_loop, A64_S, A64_N, 8),
+};
+
+/*
+ * Thumb-2
+ */
+
+#define T32_S 0x40001000U
+#define T32_N (T32_S + 0x10000)
+#define T32_F (T32_S + 0x2000000)
+
+static int relocateT32(const uint8_t *src, uint64_t src_pc, size_t min_len, uint8_t *dst, size_t dst_size, uint64_t pc, size_t *stolen){
+	return relocateThumb(src, src_pc, min_len, dst, dst_size, pc, stolen);
+}
+
+static bool decodeT32Ref(const uint8_t *out, size_t size, size_t offset, uint64_t pc, uint64_t *addr){
+	uint16_t hw1 = out[offset] | out[offset + 1] << 8;
+	uint16_t hw2 = offset + 4 <= size ? out[offset + 2] | out[offset + 3] << 8 : 0;
+	uint32_t ip = pc + offset;
+
+	if((hw1 & 0xf000) == 0xd000 && (hw1 & 0x0e00) != 0x0e00){
+		*addr = ip + 4 + signExtend((hw1 & 0xff) << 1, 9);
+	}else if((hw1 & 0xf800) == 0xe000){
+		*addr = ip + 4 + signExtend((hw1 & 0x7ff) << 1, 12);
+	}else if((hw1 & 0xf500) == 0xb100){
+		*addr = ip + 4 + (((hw1 >> 9) & 1) << 6 | ((hw1 >> 3) & 0x1f) << 1);
+	}else if((hw1 & 0xf800) == 0xf000 && (hw2 & 0x8000) && (hw2 & 0x1000)){
+		// b.w, bl
+		uint32_t s = (hw1 >> 10) & 1;
+		uint32_t i1 = !(((hw2 >> 13) & 1) ^ s);
+		uint32_t i2 = !(((hw2 >> 11) & 1) ^ s);
+		*addr = ip + 4 + signExtend(s << 24 | i1 << 23 | i2 << 22 | (hw1 & 0x3ff) << 12 | (hw2 & 0x7ff) << 1, 25);
+	}else if((hw1 & 0xf800) == 0xf000 && (hw2 & 0xd000) == 0x8000){
+		// b<c>.w
+		uint32_t s = (hw1 >> 10) & 1;
+		uint32_t j1 = (hw2 >> 13) & 1;
+		uint32_t j2 = (hw2 >> 11) & 1;
+		*addr = ip + 4 + signExtend(s << 20 | j2 << 19 | j1 << 18 | (hw1 & 0x3f) << 12 | (hw2 & 0x7ff) << 1, 21);
+	}else if((hw1 & 0xff7f) == 0xf85f){
+		uint32_t base = (ip + 4) & ~3u;
+		*addr = readLiteral(out, size, pc, hw1 & 0x80 ? base + (hw2 & 0xfff) : base - (hw2 & 0xfff), 4);
+	}else if((hw1 & 0xfbf0) == 0xf240 && offset + 8 <= size){
+		// movw rd, #lo; movt rd, #hi
+		uint16_t hw3 = out[offset + 4] | out[offset + 5] << 8;
+		uint16_t hw4 = out[offset + 6] | out[offset + 7] << 8;
+		uint32_t lo = (hw1 & 0xf) << 12 | ((hw1 >> 10) & 1) << 11 | ((hw2 >> 12) & 7) << 8 | (hw2 & 0xff);
+		uint32_t hi = (hw3 & 0xf) << 12 | ((hw3 >> 10) & 1) << 11 | ((hw4 >> 12) & 7) << 8 | (hw4 & 0xff);
+		if((hw3 & 0xfbf0) != 0xf2c0){
+			return false;
+		}
+		*addr = hi << 16 | lo;
+	}else{
+		return false;
+	}
+
+	return true;
+}
+
+static const uint8_t t32_bcc[] = {H(0xd020)};					// beq #0x40
+static const uint8_t t32_bccw[] = {H(0xf040), H(0x8200)};		// bne.w #0x400
+static const uint8_t t32_cbz[] = {H(0xb180)};					// cbz r0, #0x20
+static const uint8_t t32_bl[] = {H(0xf001), H(0xf800)};			// bl #0x1000
+static const uint8_t t32_blx[] = {H(0xf001), H(0xe800)};		// blx #0x1000
+static const uint8_t t32_bw[] = {H(0xf001), H(0xb800)};			// b.w #0x1000
+static const uint8_t t32_it_ldr[] = {
+	H(0xbf08),	// it eq
+	H(0x4802),	// ldreq r0, [pc, #8]
+};
+static const uint8_t t32_ite_add[] = {
+	H(0xbf14),	// ite ne
+	H(0x2001),	// movne r0, #1
+	H(0x4479),	// addeq r1, pc
+};
+static const uint8_t t32_it_b[] = {
+	H(0xbf08),	// it eq
+	H(0xe010),	// beq #0x20
+};
+static const uint8_t t32_add_pc[] = {H(0x447a)};				// add r2, pc
+static const uint8_t t32_mov_pc[] = {H(0x467b)};				// mov r3, pc
+static const uint8_t t32_ldrd[] = {H(0xe9df), H(0x0102)};		// ldrd r0, r1, [pc, #8]
+static const uint8_t t32_vldr[] = {H(0xed9f), H(0x0b04)};		// vldr d0, [pc, #16]
+static const uint8_t t32_ldrw[] = {H(0xf8df), H(0x1010)};		// ldr.w r1, [pc, #16]
+static const uint8_t t32_ldr[] = {H(0x4801)};					// ldr r0, [pc, #4]
+static const uint8_t t32_adr[] = {H(0xa002)};					// adr r0, #8
+static const uint8_t t32_ldr_pc[] = {H(0xf8df), H(0xf008)};		// ldr.w pc, [pc, #8]
+static const uint8_t t32_loop[] = {
+	H(0xb510),	// push {r4, lr}
+	H(0xe7fd),	// b #-6
+};
+
+static const uint8_t t32_bcc_near_out[] = {
+	H(0xf430), H(0xa820),	// beq.w #-65472
+	H(0xf7ef), H(0xbffd),	// b.w #-65542
+};
+static const RelocRef t32_bcc_near_refs[] = {{0, T32_S + 0x44}, {4, T32_S + 2}};
+static const uint8_t t32_bcc_far_out[] = {
+	H(0xd104),	// bne #8
+	H(0xbf00),	// nop
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001045),
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001003),
+};
+static const RelocRef t32_bcc_far_refs[] = {{0, T32_F + 12}, {4, T32_S + 0x45}, {12, T32_S + 3}};
+static const uint8_t t32_bccw_far_out[] = {
+	H(0xd004),	// beq #8
+	H(0xbf00),	// nop
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001405),
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001005),
+};
+static const RelocRef t32_bccw_far_refs[] = {{0, T32_F + 12}, {4, T32_S + 0x405}, {12, T32_S + 5}};
+static const uint8_t t32_cbz_near_out[] = {
+	H(0xb908),	// cbnz r0, #2
+	H(0xf7f0), H(0xb80f),	// b.w #-65506
+	H(0xf7ef), H(0xbffc),	// b.w #-65544
+};
+static const RelocRef t32_cbz_near_refs[] = {{0, T32_N + 6}, {2, T32_S + 0x24}, {6, T32_S + 2}};
+static const uint8_t t32_cbz_far_out[] = {
+	H(0xb920),	// cbnz r0, #8
+	H(0xbf00),	// nop
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001025),
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001003),
+};
+static const RelocRef t32_cbz_far_refs[] = {{0, T32_F + 12}, {4, T32_S + 0x25}, {12, T32_S + 3}};
+static const uint8_t t32_bl_near_out[] = {
+	H(0xf7f1), H(0xf800),	// bl #-61440
+	H(0xf7ef), H(0xbffe),	// b.w #-65540
+};
+static const RelocRef t32_bl_near_refs[] = {{0, T32_S + 0x1004}, {4, T32_S + 4}};
+static const uint8_t t32_bl_far_out[] = {
+	H(0xf20f), H(0x0e09),	// adr.w lr, #9
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40002005),
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001005),
+};
+static const RelocRef t32_bl_far_refs[] = {{4, T32_S + 0x1005}, {12, T32_S + 5}};
+static const uint8_t t32_blx_out[] = {
+	H(0xf20f), H(0x0e09),	// adr.w lr, #9
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40002004),
+	H(0xf7ef), H(0xbffa),	// b.w #-65548
+};
+static const RelocRef t32_blx_refs[] = {{4, T32_S + 0x1004}, {12, T32_S + 4}};
+static const uint8_t t32_bw_far_out[] = {
+	H(0xbf00),	// nop
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40002005),
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001005),
+};
+static const RelocRef t32_bw_far_refs[] = {{2, T32_S + 0x1005}, {10, T32_S + 5}};
+static const uint8_t t32_it_ldr_out[] = {
+	H(0xd105),	// bne #10
+	H(0xf241), H(0x000c),	// movw r0, #4108
+	H(0xf2c4), H(0x0000),	// movt r0, #16384
+	H(0xf8d0), H(0x0000),	// ldr.w r0, [r0]
+	H(0xf7ef), H(0xbff9),	// b.w #-65550
+};
+static const RelocRef t32_it_ldr_refs[] = {{0, T32_N + 14}, {2, T32_S + 0xc}, {14, T32_S + 4}};
+static const uint8_t t32_ite_add_out[] = {
+	H(0xbf18),	// it ne
+	H(0x2001),	// movne r0, #1
+	H(0xd106),	// bne #12
+	H(0xb401),	// push {r0}
+	H(0xf241), H(0x0008),	// movw r0, #4104
+	H(0xf2c4), H(0x0000),	// movt r0, #16384
+	H(0x4401),	// add r1, r0
+	H(0xbc01),	// pop {r0}
+	H(0xf7ef), H(0xbff7),	// b.w #-65554
+};
+static const RelocRef t32_ite_add_refs[] = {{4, T32_N + 20}, {8, T32_S + 8}, {20, T32_S + 6}};
+static const uint8_t t32_it_b_out[] = {
+	H(0xd104),	// bne #8
+	H(0xbf00),	// nop
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001027),
+	H(0xf8df), H(0xf000),	// ldr.w pc, [pc, #0]
+	W(0x40001005),
+};
+static const RelocRef t32_it_b_refs[] = {{0, T32_F + 12}, {4, T32_S + 0x27}, {12, T32_S + 5}};
+static const uint8_t t32_add_pc_out[] = {
+	H(0xb401),	// push {r0}
+	H(0xf241), H(0x0004),	// movw r0, #4100
+	H(0xf2c4), H(0x0000),	// movt r0, #16384
+	H(0x4402),	// add r2, r0
+	H(0xbc01),	// pop {r0}
+	H(0xf7ef), H(0xbff8),	// b.w #-65552
+};
+static const RelocRef t32_add_pc_refs[] = {{2, T32_S + 4}, {14, T32_S + 2}};
+static const uint8_t t32_mov_pc_out[] = {
+	H(0xf241), H(0x0304),	// movw r3, #4100
+	H(0xf2c4), H(0x0300),	// movt r3, #16384
+	H(0xf7ef), H(0xbffb),	// b.w #-65546
+};
+static const RelocRef t32_mov_pc_refs[] = {{0, T32_S + 4}, {8, T32_S + 2}};
+static const uint8_t t32_ldrd_out[] = {
+	H(0xf241), H(0x000c),	// movw r0, #4108
+	H(0xf2c4), H(0x0000),	// movt r0, #16384
+	H(0xe9d0), H(0x0100),	// ldrd r0, r1, [r0]
+	H(0xf7ef), H(0xbffa),	// b.w #-65548
+};
+static const RelocRef t32_ldrd_refs[] = {{0, T32_S + 0xc}, {12, T32_S + 4}};
+static const uint8_t t32_vldr_out[] = {
+	H(0xb401),	// push {r0}
+	H(0xf241), H(0x0014),	// movw r0, #4116
+	H(0xf2c4), H(0x0000),	// movt r0, #16384
+	H(0xed90), H(0x0b00),	// vldr d0, [r0]
+	H(0xbc01),	// pop {r0}
+	H(0xf7ef), H(0xbff8),	// b.w #-65552
+};
+static const RelocRef t32_vldr_refs[] = {{2, T32_S + 0x14}, {16, T32_S + 4}};
+static const uint8_t t32_ldrw_out[] = {
+	H(0xf241), H(0x0114),	// movw r1, #4116
+	H(0xf2c4), H(0x0100),	// movt r1, #16384
+	H(0xf8d1), H(0x1000),	// ldr.w r1, [r1]
+	H(0xf7ef), H(0xbffa),	// b.w #-65548
+};
+static const RelocRef t32_ldrw_refs[] = {{0, T32_S + 0x14}, {12, T32_S + 4}};
+static const uint8_t t32_ldr_out[] = {
+	H(0xf241), H(0x0008),	// movw r0, #4104
+	H(0xf2c4), H(0x0000),	// movt r0, #16384
+	H(0xf8d0), H(0x0000),	// ldr.w r0, [r0]
+	H(0xf7ef), H(0xbff9),	// b.w #-65550
+};
+static const RelocRef t32_ldr_refs[] = {{0, T32_S + 8}, {12, T32_S + 2}};
+static const uint8_t t32_adr_out[] = {
+	H(0xf241), H(0x000c),	// movw r0, #4108
+	H(0xf2c4), H(0x0000),	// movt r0, #16384
+	H(0xf7ef), H(0xbffb),	// b.w #-65546
+};
+static const RelocRef t32_adr_refs[] = {{0, T32_S + 0xc}, {8, T32_S + 2}};
+
+static const RelocCase t32_cases[] = {
+	RELOC_CASE("b<c> near", t32_bcc, T32_S, T32_N, 2, 2, t32_bcc_near_out, t32_bcc_near_refs),
+	RELOC_CASE("b<c> far", t32_bcc, T32_S, T32_F, 2, 2, t32_bcc_far_out, t32_bcc_far_refs),
+	RELOC_CASE("b<c>.w far", t32_bccw, T32_S, T32_F, 4, 4, t32_bccw_far_out, t32_bccw_far_refs),
+	RELOC_CASE("cbz near", t32_cbz, T32_S, T32_N, 2, 2, t32_cbz_near_out, t32_cbz_near_refs),
+	RELOC_CASE("cbz far", t32_cbz, T32_S, T32_F, 2, 2, t32_cbz_far_out, t32_cbz_far_refs),
+	RELOC_CASE("bl near", t32_bl, T32_S, T32_N, 4, 4, t32_bl_near_out, t32_bl_near_refs),
+	RELOC_CASE("bl far", t32_bl, T32_S, T32_F, 4, 4, t32_bl_far_out, t32_bl_far_refs),
+	RELOC_CASE("blx to arm", t32_blx, T32_S, T32_N, 4, 4, t32_blx_out, t32_blx_refs),
+	RELOC_CASE("b.w far, unaligned pc", t32_bw, T32_S, T32_F + 2, 4, 4, t32_bw_far_out, t32_bw_far_refs),
+	RELOC_CASE("it ldr literal", t32_it_ldr, T32_S, T32_N, 4, 4, t32_it_ldr_out, t32_it_ldr_refs),
+	RELOC_CASE("ite split, add pc", t32_ite_add, T32_S, T32_N, 6, 6, t32_ite_add_out, t32_ite_add_refs),
+	RELOC_CASE("it b far", t32_it_b, T32_S, T32_F, 4, 4, t32_it_b_out, t32_it_b_refs),
+	RELOC_CASE("add pc", t32_add_pc, T32_S, T32_N, 2, 2, t32_add_pc_out, t32_add_pc_refs),
+	RELOC_CASE("mov pc", t32_mov_pc, T32_S, T32_N, 2, 2, t32_mov_pc_out, t32_mov_pc_refs),
+	RELOC_CASE("ldrd literal", t32_ldrd, T32_S, T32_N, 4, 4, t32_ldrd_out, t32_ldrd_refs),
+	RELOC_CASE("vldr literal", t32_vldr, T32_S, T32_N, 4, 4, t32_vldr_out, t32_vldr_refs),
+	RELOC_CASE("ldr.w literal", t32_ldrw, T32_S, T32_N, 4, 4, t32_ldrw_out, t32_ldrw_refs),
+	RELOC_CASE("ldr literal", t32_ldr, T32_S, T32_N, 2, 2, t32_ldr_out, t32_ldr_refs),
+	RELOC_CASE("adr", t32_adr, T32_S, T32_N, 2, 2, t32_adr_out, t32_adr_refs),
+	RELOC_FAIL("ldr pc literal", t32_ldr_pc, T32_S, T32_N, 4),
+	RELOC_FAIL("branch into stolen bytes", t32_loop, T32_S, T32_N, 4),
+};
+
+/*
+ * x86-64, relocateX64 takes the source address as its pc, the code is copied to X64_S first
+ */
+
+#define X64_S 0x100000000ULL
+#define X64_N (X64_S + 0x1000)
+#define X64_F (X64_S + 0x100000000ULL)
+
+// the rel32 from here to the Jcc target is 1 << 31, the jump after the skip still fits
+#define X64_J (X64_S + 0x12 - 6 - 0x80000000ULL)
+
+static int relocateX86(const uint8_t *src, uint64_t src_pc, size_t min_len, uint8_t *dst, size_t dst_size, uint64_t pc, size_t *stolen){
+	memcpy((void *)src_pc, src, 16);
+	return relocateX64((const uint8_t *)src_pc, min_len, dst, dst_size, pc, stolen);
+}
+
+static bool decodeX64Ref(const uint8_t *out, size_t size, size_t offset, uint64_t pc, uint64_t *addr){
+	const uint8_t *code = out + offset;
+	uint64_t ip = pc + offset;
+
+	if(code[0] == 0xe8 || code[0] == 0xe9){
+		*addr = ip + 5 + (int32_t)read32(code + 1);
+	}else if(code[0] == 0x0f && (code[1] & 0xf0) == 0x80){
+		*addr = ip + 6 + (int32_t)read32(code + 2);
+	}else if((code[0] & 0xf0) == 0x70 || code[0] == 0xeb){
+		*addr = ip + 2 + (int8_t)code[1];
+	}else if(code[0] == 0xff && (code[1] == 0x25 || code[1] == 0x15)){
+		*addr = readLiteral(out, size, pc, ip + 6 + (int32_t)read32(code + 2), 8);
+	}else if(code[0] == 0x48 && code[1] == 0x8b && (code[2] & 0xc7) == 0x05){
+		*addr = ip + 7 + (int32_t)read32(code + 3);
+	}else{
+		return false;
+	}
+
+	return true;
+}
+
+static const uint8_t x64_jcc[] = {0x74, 0x10, 0x90, 0x90, 0x90};				// je +0x10; nop x3
+static const uint8_t x64_call[] = {0xe8, 0x00, 0x10, 0x00, 0x00};				// call +0x1000
+static const uint8_t x64_mov_rip[] = {0x48, 0x8b, 0x05, 0x00, 0x01, 0x00, 0x00};	// mov rax, [rip + 0x100]
+static const uint8_t x64_loop[] = {0x90, 0x90, 0x90, 0xeb, 0xfb};				// nop x3; jmp -5
+
+static const uint8_t x64_jcc_near_out[] = {
+	0x0f, 0x84, 0x0c, 0xf0, 0xff, 0xff,	// je -4084
+	0x90,	// nop
+	0x90,	// nop
+	0x90,	// nop
+	0xe9, 0xf7, 0xef, 0xff, 0xff,	// jmp -4105
+};
+static const RelocRef x64_jcc_near_refs[] = {{0, X64_S + 0x12}, {9, X64_S + 5}};
+static const uint8_t x64_jcc_far_out[] = {
+	0x75, 0x0e,	// jne 14
+	0xff, 0x25, 0x00, 0x00, 0x00, 0x00,	// jmpq *(%rip)
+	D(0x100000012),
+	0x90,	// nop
+	0x90,	// nop
+	0x90,	// nop
+	0xff, 0x25, 0x00, 0x00, 0x00, 0x00,	// jmpq *(%rip)
+	D(0x100000005),
+};
+static const RelocRef x64_jcc_far_refs[] = {{0, X64_F + 16}, {2, X64_S + 0x12}, {19, X64_S + 5}};
+static const uint8_t x64_jcc_skip_out[] = {
+	0x75, 0x05,	// jne 5
+	0xe9, 0xff, 0xff, 0xff, 0x7f,	// jmp 2147483647
+	0x90,	// nop
+	0x90,	// nop
+	0x90,	// nop
+	0xe9, 0xea, 0xff, 0xff, 0x7f,	// jmp 2147483626
+};
+static const RelocRef x64_jcc_skip_refs[] = {{0, X64_J + 7}, {2, X64_S + 0x12}, {10, X64_S + 5}};
+static const uint8_t x64_call_near_out[] = {
+	0xe8, 0x00, 0x00, 0x00, 0x00,	// callq 0
+	0xe9, 0xfb, 0xef, 0xff, 0xff,	// jmp -4101
+};
+static const RelocRef x64_call_near_refs[] = {{0, X64_S + 0x1005}, {5, X64_S + 5}};
+static const uint8_t x64_call_far_out[] = {
+	0xff, 0x15, 0x02, 0x00, 0x00, 0x00,	// callq *2(%rip)
+	0xeb, 0x08,	// jmp 8
+	D(0x100001005),
+	0xff, 0x25, 0x00, 0x00, 0x00, 0x00,	// jmpq *(%rip)
+	D(0x100000005),
+};
+static const RelocRef x64_call_far_refs[] = {{0, X64_S + 0x1005}, {6, X64_F + 16}, {16, X64_S + 5}};
+static const uint8_t x64_mov_rip_out[] = {
+	0x48, 0x8b, 0x05, 0x00, 0xf1, 0xff, 0xff,	// movq -3840(%rip), %rax
+	0xe9, 0xfb, 0xef, 0xff, 0xff,	// jmp -4101
+};
+static const RelocRef x64_mov_rip_refs[] = {{0, X64_S + 0x107}, {7, X64_S + 7}};
+
+static const RelocCase x64_cases[] = {
+	RELOC_CASE("jcc near", x64_jcc, X64_S, X64_N, 5, 5, x64_jcc_near_out, x64_jcc_near_refs),
+	RELOC_CASE("jcc far", x64_jcc, X64_S, X64_F, 5, 5, x64_jcc_far_out, x64_jcc_far_refs),
+	RELOC_CASE("jcc skip over rel32", x64_jcc, X64_S, X64_J, 5, 5, x64_jcc_skip_out, x64_jcc_skip_refs),
+	RELOC_CASE("call near", x64_call, X64_S, X64_N, 5, 5, x64_call_near_out, x64_call_near_refs),
+	RELOC_CASE("call far", x64_call, X64_S, X64_F, 5, 5, x64_call_far_out, x64_call_far_refs),
+	RELOC_CASE("rip relative near", x64_mov_rip, X64_S, X64_N, 5, 7, x64_mov_rip_out, x64_mov_rip_refs),
+	RELOC_FAIL("rip relative far", x64_mov_rip, X64_S, X64_F, 5),
+	RELOC_FAIL("branch into stolen bytes", x64_loop, X64_S, X64_N, 5),
+};
+
+static bool dump = false;
+
+static void dumpOutput(const char *arch, const RelocCase *test, const uint8_t *out, int len){
+	printf("%s %s, %d bytes:\n\t", arch, test->name, len);
+	for(int i = 0; i < len; i++){
+		printf("0x%02x,%s", out[i], (i & 7) == 7 ? "\n\t" : " ");
+	}
+	printf("\n");
+}
+
+static int runCase(const char *arch, const RelocCase *test, Relocator relocate, RefDecoder decode){
+	uint8_t out[OUT_SIZE];
+	size_t stolen = 0;
+
+	memset(out, 0xcc, sizeof(out));
+	int len = relocate(test->code, test->src_pc, test->min_len, out, sizeof(out), test->pc, &stolen);
+
+	if(dump){
+		dumpOutput(arch, test, out, len);
+	}
+
+	if(!test->expect){
+		if(len >= 0){
+			printf("[-] %s %s: relocated %d bytes, expected a failure\n", arch, test->name, len);
+			return 1;
+		}
+		return 0;
+	}
+
+	if(len != (int)test->expectsz || stolen != test->stolen){
+		printf("[-] %s %s: %d bytes and %d stolen, expected %d and %d\n", arch, test->name, len, (int)stolen,
+				(int)test->expectsz, (int)test->stolen);
+		return 1;
+	}
+
+	if(memcmp(out, test->expect, len)){
+		for(int i = 0; i < len; i++){
+			if(out[i] != test->expect[i]){
+				printf("[-] %s %s: byte %d is 0x%02x, expected 0x%02x\n", arch, test->name, i, out[i], test->expect[i]);
+				break;
+			}
+		}
+		return 1;
+	}
+
+	for(size_t i = 0; i < test->nrefs; i++){
+		const RelocRef &ref = test->refs[i];
+		uint64_t addr = 0;
+
+		if(!decode(out, len, ref.offset, test->pc, &addr) || addr != ref.addr){
+			printf("[-] %s %s: offset %d refers to 0x%llx, expected 0x%llx\n", arch, test->name, (int)ref.offset,
+					(unsigned long long)addr, (unsigned long long)ref.addr);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int runCases(const char *arch, const RelocCase *cases, size_t n, Relocator relocate, RefDecoder decode){
+	int failed = 0;
+
+	for(size_t i = 0; i < n; i++){
+		failed += runCase(arch, cases + i, relocate, decode);
+	}
+
+	printf("[%s] %s: %d/%d passed\n", failed ? "-" : "+", arch, (int)(n - failed), (int)n);
+	return failed;
+}
+
+int main(int argc, char **argv){
+	dump = argc > 1 && !strcmp(argv[1], "--dump");
+
+	// relocateX64 reads the code where it pretends to run
+	void *page = mmap((void *)X64_S, 0x1000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if(page != (void *)X64_S){
+		printf("[-] could not map the x86-64 source page at 0x%llx\n", (unsigned long long)X64_S);
+		return 1;
+	}
+
+	int failed = 0;
+	failed += runCases("arm64", a64_cases, sizeof(a64_cases) / sizeof(a64_cases[0]), relocateA64, decodeA64Ref);
+	failed += runCases("thumb", t32_cases, sizeof(t32_cases) / sizeof(t32_cases[0]), relocateT32, decodeT32Ref);
+	failed += runCases("x86-64", x64_cases, sizeof(x64_cases) / sizeof(x64_cases[0]), relocateX86, decodeX64Ref);
+
+	munmap(page, 0x1000);
+	return failed ? 1 : 0;
+}
@@ -21,22 +21,26 @@ extern "C" void art_quick_dispatcher(ArtMethod*);
 extern "C" uint64_t art_quick_call_entrypoint(ArtMethod* method, Thread *self, u4 **args, u4 **old_sp, const void *entrypoint);
 extern "C" uint64_t artQuickToDispatcher(ArtMethod* method, Thread *self, u4 **args, u4 **old_sp){
 	HookInfo *info = (HookInfo *)method->GetNativeMethod();
-	LOGI("[+] entry ArtHandler %s->%s", info->classDesc, info->methodName);
+	LOGD("[+] entry ArtHandler %s->%s", info->classDesc, info->methodName);
 
+	// called for every hooked java call, the class names are only for debug logs
+#if LOG_ENABLED(LOG_LEVEL_DEBUG)
 	// If it not is static method, then args[0] was pointing to this
 	if(!info->isStaticMethod){
 		Object *thiz = reinterpret_cast<Object *>(args[0]);
 		if(thiz != NULL){
 			char *bytes = get_chars_from_utf16(thiz->GetClass()->GetName());
-			LOGI("[+] thiz class is %s", bytes);
+			LOGD("[+] thiz class is %s", bytes);
 			delete bytes;
 		}
 	}
+#endif
 
 	const void *entrypoint = info->entrypoint;
 	method->SetNativeMethod(info->nativecode); //restore nativecode for JNI method
 	uint64_t res = art_quick_call_entrypoint(method, self, args, old_sp, entrypoint);
 
+#if LOG_ENABLED(LOG_LEVEL_DEBUG)
 	JValue* result = (JValue* )&res;
 	if(result != NULL){
 		Object *obj = result->l;
@@ -44,14 +48,15 @@ extern "C" uint64_t artQuickToDispatcher(ArtMethod* method, Thread *self, u4 **a
 
 		if(strcmp(raw_class_name, "java.lang.String") == 0){
 			char *raw_string_value = get_chars_from_utf16((String *)obj);
-			LOGI("result-class %s, result-value \"%s\"", raw_class_name, raw_string_value);
+			LOGD("result-class %s, result-value \"%s\"", raw_class_name, raw_string_value);
 			free(raw_string_value);
 		}else{
-			LOGI("result-class %s", raw_class_name);
+			LOGD("result-class %s", raw_class_name);
 		}
 
 		free(raw_class_name);
 	}
+#endif
 
 	// entrypoid may be replaced by trampoline, only once.
 //	if(method->IsStatic() && !method->IsConstructor()){
@@ -0,0 +1,302 @@
+/*
+ * asynclog.cpp
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#if defined(__ANDROID__)
+#include <android/log.h>
+#endif
+
+#include "common.h"
+#include "asynclog.h"
+
+#define CACHE_LINE 64
+#define LOG_QUEUE_SIZE 512
+#define LOG_LINE_SIZE 512
+
+/**
+ * 多生产者单消费者的有界队列, 每条记录的seq表示它当前可以被谁使用:
+ * seq == pos时可以写入, seq == pos + 1时已提交, 可以读出
+ */
+static LogRecord queue[LOG_QUEUE_SIZE];
+
+static uint64_t enqueue_pos __attribute__((aligned(CACHE_LINE)));
+static uint64_t dropped;
+static uint64_t dequeue_pos __attribute__((aligned(CACHE_LINE)));
+static uint64_t reported;
+
+static sem_t log_sem;
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const CONVERSIONS = "diouxXcspfFeEgGaAn";
+
+static void writeLine(int level, const char *tag, const char *line){
+#if defined(__ANDROID__)
+	__android_log_write(level, tag, line);
+#else
+	static const char LEVELS[] = "??VDIWEF";
+	fprintf(stderr, "%c/%s: %s\n", level < (int)sizeof(LEVELS) - 1 ? LEVELS[level] : '?', tag, line);
+#endif
+}
+
+/**
+ * 取出一个整数参数, 按长度修饰符截断成printf对应的类型
+ */
+static long long intArg(uint64_t v, const char *mods, bool is_signed){
+	if(!strcmp(mods, "hh")){
+		return is_signed ? (long long)(signed char)v : (long long)(unsigned char)v;
+	}else if(!strcmp(mods, "h")){
+		return is_signed ? (long long)(short)v : (long long)(unsigned short)v;
+	}else if(!strcmp(mods, "l") || !strcmp(mods, "z") || !strcmp(mods, "t")){
+		return is_signed ? (long long)(long)v : (long long)(unsigned long)v;
+	}else if(!strcmp(mods, "ll") || !strcmp(mods, "q") || !strcmp(mods, "j")){
+		return (long long)v;
+	}
+	return is_signed ? (long long)(int)v : (long long)(unsigned int)v;
+}
+
+/**
+ * 按格式串把一条记录格式化到line, 每个转换说明连同自己的参数单独交给snprintf
+ */
+static void formatRecord(const LogRecord *record, char *line, size_t size){
+	size_t len = 0;
+	int next = 0;
+	const char *p = record->fmt;
+
+	while(*p && len + 1 < size){
+		if(*p != '%'){
+			line[len++] = *p++;
+			continue;
+		}
+
+		if(p[1] == '%'){
+			line[len++] = '%';
+			p += 2;
+			continue;
+		}
+
+		const char *start = p++;
+		char spec[32];
+		char mods[4];
+		size_t nspec = 0, nmods = 0;
+		spec[nspec++] = '%';
+
+		while(*p && !strchr(CONVERSIONS, *p)){
+			if(*p == '*'){
+				// width or precision comes from the arguments
+				int v = next < record->nargs ? (int)record->args[next++] : 0;
+				int n = snprintf(spec + nspec, sizeof(spec) - nspec, "%d", v);
+				nspec = n > 0 && nspec + n + 4 < sizeof(spec) ? nspec + n : nspec;
+			}else if(strchr("hlLqjzt", *p)){
+				if(nmods + 1 < sizeof(mods)){
+					mods[nmods++] = *p;
+				}
+			}else if(nspec + 4 < sizeof(spec)){
+				spec[nspec++] = *p;
+			}
+			p++;
+		}
+		mods[nmods] = '\0';
+
+		char conv = *p;
+		if(!conv || next >= record->nargs){
+			// nothing to print it with, keep the text as it is
+			size_t n = (conv ? p + 1 : p) - start;
+			n = n < size - 1 - len ? n : size - 1 - len;
+			memcpy(line + len, start, n);
+			len += n;
+			p = conv ? p + 1 : p;
+			continue;
+		}
+		p++;
+
+		uint8_t type = record->types[next];
+		uint64_t v = record->args[next++];
+		char *out = line + len;
+		size_t room = size - len;
+		int n = 0;
+
+		switch(conv){
+		case 'd':
+		case 'i':
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X': {
+			bool is_signed = conv == 'd' || conv == 'i';
+			if(type == LOG_ARG_DOUBLE){
+				double d;
+				memcpy(&d, &v, sizeof(d));
+				v = (uint64_t)(int64_t)d;
+			}
+			spec[nspec++] = 'l';
+			spec[nspec++] = 'l';
+			spec[nspec++] = conv;
+			spec[nspec] = '\0';
+			n = snprintf(out, room, spec, intArg(v, mods, is_signed));
+			break;
+		}
+
+		case 'c':
+		case 'p':
+			spec[nspec++] = conv;
+			spec[nspec] = '\0';
+			if(conv == 'c'){
+				n = snprintf(out, room, spec, (int)v);
+			}else{
+				n = snprintf(out, room, spec, (void *)(uintptr_t)v);
+			}
+			break;
+
+		case 's': {
+			spec[nspec++] = 's';
+			spec[nspec] = '\0';
+
+			// a pointer of another type can not be read safely here
+			const char *s = "(?)";
+			if(type == LOG_ARG_STR){
+				s = v == UINT64_MAX ? "(null)" : record->text + v;
+			}
+			n = snprintf(out, room, spec, s);
+			break;
+		}
+
+		case 'n':
+			break;
+
+		default: {
+			double d;
+			if(type == LOG_ARG_DOUBLE){
+				memcpy(&d, &v, sizeof(d));
+			}else{
+				d = (double)(int64_t)v;
+			}
+			spec[nspec++] = conv;
+			spec[nspec] = '\0';
+			n = snprintf(out, room, spec, d);
+			break;
+		}
+		}
+
+		if(n > 0){
+			len += (size_t)n < room ? n : room - 1;
+		}
+	}
+
+	line[len] = '\0';
+}
+
+static void drainQueue(){
+	pthread_mutex_lock(&drain_lock);
+
+	char line[LOG_LINE_SIZE];
+	uint64_t pos = dequeue_pos;
+	for(;;){
+		LogRecord *record = &queue[pos & (LOG_QUEUE_SIZE - 1)];
+		if(__atomic_load_n(&record->seq, __ATOMIC_SEQ_CST) != pos + 1){
+			break;
+		}
+
+		formatRecord(record, line, sizeof(line));
+		writeLine(record->level, record->tag, line);
+
+		__atomic_store_n(&record->seq, pos + LOG_QUEUE_SIZE, __ATOMIC_RELEASE);
+
+		// pairs with logCommit, either it sees the queue empty or the record is seen here
+		__atomic_store_n(&dequeue_pos, ++pos, __ATOMIC_SEQ_CST);
+	}
+
+	uint64_t ndropped = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+	if(ndropped != reported){
+		snprintf(line, sizeof(line), "[*] %llu log records dropped.", (unsigned long long)(ndropped - reported));
+		writeLine(LOG_LEVEL_WARN, LOG_TAG, line);
+		reported = ndropped;
+	}
+
+	pthread_mutex_unlock(&drain_lock);
+}
+
+static void *logMain(void *){
+	for(;;){
+		while(sem_wait(&log_sem) && errno == EINTR){
+		}
+		drainQueue();
+	}
+	return NULL;
+}
+
+static void startLogger(){
+	for(uint64_t i = 0; i < LOG_QUEUE_SIZE; i++){
+		queue[i].seq = i;
+	}
+
+	sem_init(&log_sem, 0, 0);
+
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if(pthread_create(&thread, &attr, logMain, NULL)){
+		// records are still written out by logFlush
+		writeLine(LOG_LEVEL_ERROR, LOG_TAG, "[-] could not start the log thread.");
+	}
+	pthread_attr_destroy(&attr);
+
+	atexit(logFlush);
+}
+
+LogRecord *logBegin(int level, const char *tag, const char *fmt){
+	pthread_once(&log_once, startLogger);
+
+	uint64_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+	for(;;){
+		LogRecord *record = &queue[pos & (LOG_QUEUE_SIZE - 1)];
+		int64_t diff = (int64_t)(__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) - pos);
+
+		if(diff == 0){
+			if(__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+				record->pos = pos;
+				record->tag = tag;
+				record->fmt = fmt;
+				record->level = level;
+				record->nargs = 0;
+				record->text_used = 0;
+				return record;
+			}
+		}else if(diff < 0){
+			__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+			return NULL;
+		}else{
+			pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void logCommit(LogRecord *record){
+	uint64_t pos = record->pos;
+	__atomic_store_n(&record->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	// only the record at the head wakes the drainer, the ones behind it are drained with it
+	if(__atomic_load_n(&dequeue_pos, __ATOMIC_SEQ_CST) == pos){
+		sem_post(&log_sem);
+	}
+}
+
+void logFlush(){
+	pthread_once(&log_once, startLogger);
+	drainQueue();
+}
+
+uint64_t logDropped(){
+	return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
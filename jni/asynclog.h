@@ -0,0 +1,134 @@
+/*
+ * asynclog.h
+ *
+ *  Created on: 2026年10月17日
+ *      Author: boyliang
+ */
+
+#ifndef ASYNCLOG_H_
+#define ASYNCLOG_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define LOG_MAX_ARGS 8
+#define LOG_TEXT_SIZE 144
+
+enum {
+	LOG_ARG_INT,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_STR,
+};
+
+/**
+ * 队列中的一条日志, 只保存格式串指针和原始参数, 由后台线程格式化
+ * 字符串参数在调用时就可能被释放, 所以复制到text中, 放不下的部分截断
+ */
+struct LogRecord {
+	uint64_t seq;
+	uint64_t pos;
+	const char *tag;
+	const char *fmt;
+	uint8_t level;
+	uint8_t nargs;
+	uint8_t text_used;
+	uint8_t types[LOG_MAX_ARGS];
+	uint64_t args[LOG_MAX_ARGS];
+	char text[LOG_TEXT_SIZE];
+};
+
+/**
+ * 在队列中占一条记录, 队列满时丢弃并计数, 返回NULL
+ * 不加锁也不分配内存, 可以在hook函数中调用
+ */
+LogRecord *logBegin(int level, const char *tag, const char *fmt);
+
+/**
+ * 提交logBegin得到的记录, 队列原来为空时唤醒后台线程
+ */
+void logCommit(LogRecord *record);
+
+/**
+ * 在当前线程格式化并输出队列中的所有记录
+ */
+void logFlush();
+
+/**
+ * 因队列满而丢弃的日志条数
+ */
+uint64_t logDropped();
+
+static inline void logArg(LogRecord *record, const char *s){
+	record->types[record->nargs] = LOG_ARG_STR;
+	if(!s){
+		record->args[record->nargs++] = UINT64_MAX;
+		return;
+	}
+
+	size_t room = LOG_TEXT_SIZE - record->text_used;
+	if(!room){
+		// the last byte is the terminator of the string before
+		record->args[record->nargs++] = LOG_TEXT_SIZE - 1;
+		return;
+	}
+
+	size_t len = strnlen(s, room - 1);
+	memcpy(record->text + record->text_used, s, len);
+	record->text[record->text_used + len] = '\0';
+	record->args[record->nargs++] = record->text_used;
+	record->text_used += len + 1;
+}
+
+static inline void logArg(LogRecord *record, char *s){
+	logArg(record, (const char *)s);
+}
+
+static inline void logArg(LogRecord *record, double v){
+	record->types[record->nargs] = LOG_ARG_DOUBLE;
+	memcpy(&record->args[record->nargs++], &v, sizeof(v));
+}
+
+static inline void logArg(LogRecord *record, float v){
+	logArg(record, (double)v);
+}
+
+static inline void logArg(LogRecord *record, long double v){
+	logArg(record, (double)v);
+}
+
+template<typename T>
+static inline void logArg(LogRecord *record, T *p){
+	record->types[record->nargs] = LOG_ARG_INT;
+	record->args[record->nargs++] = (uintptr_t)p;
+}
+
+template<typename T>
+static inline void logArg(LogRecord *record, T v){
+	record->types[record->nargs] = LOG_ARG_INT;
+	record->args[record->nargs++] = (uint64_t)(int64_t)v;
+}
+
+static inline void logArgs(LogRecord *){
+}
+
+template<typename T, typename... Rest>
+static inline void logArgs(LogRecord *record, T arg, Rest... rest){
+	logArg(record, arg);
+	logArgs(record, rest...);
+}
+
+/**
+ * LOGI等宏的实现, 调用线程只复制参数, 不做格式化和IO
+ */
+template<typename... Args>
+static inline void asyncLog(int level, const char *tag, const char *fmt, Args... args){
+	static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+
+	LogRecord *record = logBegin(level, tag, fmt);
+	if(record){
+		logArgs(record, args...);
+		logCommit(record);
+	}
+}
+
+#endif /* ASYNCLOG_H_ */
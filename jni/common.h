@@ -8,24 +8,72 @@
 #ifndef COMMON_H_
 #define COMMON_H_
 
-#include <cutils/log.h>
 #include <stdlib.h>
 
 #ifdef LOG_TAG
 #undef LOG_TAG
-#define LOG_TAG "TTT"
 #endif
+#define LOG_TAG "TTT"
+
+/**
+ * 日志级别, 取值与android_LogPriority相同
+ */
+#define LOG_LEVEL_VERBOSE 2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_INFO 4
+#define LOG_LEVEL_WARN 5
+#define LOG_LEVEL_ERROR 6
+#define LOG_LEVEL_NONE 8
 
+/**
+ * 低于LOG_MIN_LEVEL的日志在编译期去掉, 参数也不会求值
+ * 没有指定时, 定义了DEBUG输出INFO及以上, 否则全部去掉
+ */
+#ifndef LOG_MIN_LEVEL
 #ifdef DEBUG
-#define LOGI(...) ALOGI(__VA_ARGS__)
-#define LOGE(...) ALOGE(__VA_ARGS__)
-#define LOGW(...) ALOGW(__VA_ARGS__)
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_NONE
+#endif
+#endif
+
+#define LOG_ENABLED(LEVEL) (LOG_MIN_LEVEL <= (LEVEL))
+
+// enabled levels only copy the arguments, a background thread formats them
+#if LOG_ENABLED(LOG_LEVEL_ERROR)
+#include "asynclog.h"
+#endif
+
+#if LOG_ENABLED(LOG_LEVEL_VERBOSE)
+#define LOGV(...) asyncLog(LOG_LEVEL_VERBOSE, LOG_TAG, __VA_ARGS__)
+#else
+#define LOGV(...) while(0){}
+#endif
+
+#if LOG_ENABLED(LOG_LEVEL_DEBUG)
+#define LOGD(...) asyncLog(LOG_LEVEL_DEBUG, LOG_TAG, __VA_ARGS__)
+#else
+#define LOGD(...) while(0){}
+#endif
+
+#if LOG_ENABLED(LOG_LEVEL_INFO)
+#define LOGI(...) asyncLog(LOG_LEVEL_INFO, LOG_TAG, __VA_ARGS__)
 #else
 #define LOGI(...) while(0){}
-#define LOGE(...) while(0){}
+#endif
+
+#if LOG_ENABLED(LOG_LEVEL_WARN)
+#define LOGW(...) asyncLog(LOG_LEVEL_WARN, LOG_TAG, __VA_ARGS__)
+#else
 #define LOGW(...) while(0){}
 #endif
 
+#if LOG_ENABLED(LOG_LEVEL_ERROR)
+#define LOGE(...) asyncLog(LOG_LEVEL_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#define LOGE(...) while(0){}
+#endif
+
 #define CHECK_VALID(V) 				\
 	if(V == NULL){					\
 		LOGE("%s is null.", #V);	\
@@ -6,6 +6,7 @@
 #include "JavaHook/JavaMethodHook.h"
 #include "ELFHook/elfutils.h"
 #include "ElfHook/elfhook.h"
+#include "ElfHook/elfhookt.h"
 #include "common.h"
 
 
@@ -28,26 +29,27 @@ extern "C" jint Java_com_example_allhookinone_HookUtils_hookMethodNative(JNIEnv
 }
 
 
-typedef int (*strlen_fun)(const char *);
-strlen_fun old_strlen = NULL;
+typedef size_t (*strlen_fun)(const char *);
+size_t my_strlen(const char *str);
+typedef ELF_HOOK_T(strlen, my_strlen) StrlenHook;
 
 size_t my_strlen(const char *str){
 	LOGI("strlen was called.");
-	int len = old_strlen(str);
+	size_t len = StrlenHook::original(str);
 	return len * 2;
 }
 
 
-strlen_fun global_strlen1 = (strlen_fun)strlen;
-strlen_fun global_strlen2 = (strlen_fun)strlen;
+strlen_fun global_strlen1 = strlen;
+strlen_fun global_strlen2 = strlen;
 
 #define SHOW(x) LOGI("%s is %d", #x, x)
 
 extern "C" jint Java_com_example_allhookinone_HookUtils_elfhook(JNIEnv *env, jobject thiz){
 	const char *str = "helloworld";
 
-	strlen_fun local_strlen1 = (strlen_fun)strlen;
-	strlen_fun local_strlen2 = (strlen_fun)strlen;
+	strlen_fun local_strlen1 = strlen;
+	strlen_fun local_strlen2 = strlen;
 
 	int len0 = global_strlen1(str);
 	int len1 = global_strlen2(str);
@@ -64,7 +66,10 @@ extern "C" jint Java_com_example_allhookinone_HookUtils_elfhook(JNIEnv *env, job
 	SHOW(len4);
 	SHOW(len5);
 
-	elfHook("libonehook.so", "strlen", (void *)my_strlen, (void **)&old_strlen);
+	StrlenHook::install("libonehook.so", "strlen");
+
+	// global_strlen1/2 hold the address of strlen, they are found by value
+	elfHookAddress("libonehook.so", (void *)StrlenHook::original, (void *)my_strlen, (void **)&StrlenHook::original);
 
 	len0 = global_strlen1(str);
 	len1 = global_strlen2(str);